@@ -123,6 +123,7 @@ extern "C" {
 #include "chcond.h"
 #include "chevents.h"
 #include "chmsg.h"
+#include "chadm.h"
 #include "chss.h"
 /* OSLIB.*/
 #include "chlib.h"
@@ -0,0 +1,140 @@
+/*
+    ChibiOS - Copyright (C) 2006..2018 Giovanni Di Sirio.
+    This file is part of ChibiOS.
+    ChibiOS is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+    ChibiOS is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/*
+    This file is not part of the original ChibiOs 191.
+    Copyright (C) 2021 Antonio Emmanuele.
+*/
+/**
+ * @file    chadm.h
+ * @brief   Admission control module macros and structures.
+ *
+ * @addtogroup Admission
+ * @{
+ */
+#ifndef CHADM_H
+#define CHADM_H
+
+#include "ch.h"
+
+/*===========================================================================*/
+/* Module constants.                                                         */
+/*===========================================================================*/
+
+/*===========================================================================*/
+/* Module pre-compile time settings.                                         */
+/*===========================================================================*/
+/*
+ * @brief   Admission control of the periodic threads and of the sporadic servers.
+ */
+#if !defined(CH_CFG_USE_SS_ADMISSION)
+#define CH_CFG_USE_SS_ADMISSION FALSE
+#endif
+/*
+ * @brief   Schedulability test used by the admission.
+ * @note    If TRUE the exact response time analysis is used, else the Liu-Layland utilization bound.
+ */
+#if !defined(SS_ADMISSION_RTA)
+#define SS_ADMISSION_RTA TRUE
+#endif
+
+#if CH_CFG_USE_SS_ADMISSION == TRUE
+
+/*===========================================================================*/
+/* Derived constants and error checks.                                       */
+/*===========================================================================*/
+#if CH_CFG_USE_SS == FALSE
+#error "CH_CFG_USE_SS_ADMISSION requires CH_CFG_USE_SS"
+#endif
+#if CH_CFG_USE_MUTEXES == FALSE
+#error "CH_CFG_USE_SS_ADMISSION requires CH_CFG_USE_MUTEXES"
+#endif
+
+/*===========================================================================*/
+/* Module data structures and types.                                         */
+/*===========================================================================*/
+
+/*
+ * @brief   Type of an admitted task.
+ */
+typedef struct adm_task adm_task_t;
+
+/*
+ * @brief   Structure representing an admitted task, a periodic thread or a server.
+ * @note    All the times are in system ticks and the deadline must not be greater than the period.
+ */
+struct adm_task {
+  /*
+   * @brief   Next task in the admitted set
+   */
+  adm_task_t *next;
+  /*
+   * @brief   Thread whose priority is used by the analysis, NULL to use @p prio
+   */
+  thread_t *tp;
+  /*
+   * @brief   Priority used when @p tp is NULL
+   */
+  tprio_t prio;
+  /*
+   * @brief   Worst case execution time (C)
+   */
+  sysinterval_t wcet;
+  /*
+   * @brief   Period or minimum inter-arrival time (T)
+   */
+  sysinterval_t period;
+  /*
+   * @brief   Relative deadline (D)
+   */
+  sysinterval_t deadline;
+  /*
+   * @brief   Release jitter (J), T-C for a deferrable server
+   */
+  sysinterval_t jitter;
+  /*
+   * @brief   The task is in the admitted set
+   */
+  bool admitted;
+};
+
+/*===========================================================================*/
+/* Module macros.                                                            */
+/*===========================================================================*/
+
+/*===========================================================================*/
+/* External declarations.                                                    */
+/*===========================================================================*/
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+  void chAdmTaskObjectInit(adm_task_t*,thread_t*,sysinterval_t,sysinterval_t,sysinterval_t);
+  bool chAdmTaskAdmit(adm_task_t*);
+  bool chAdmTaskChange(adm_task_t*,sysinterval_t,sysinterval_t,sysinterval_t,sysinterval_t);
+  void chAdmTaskRemove(adm_task_t*);
+  bool chAdmIsSchedulable(void);
+  bool chAdmResponseTimeTest(adm_task_t*);
+  bool chAdmUtilizationTest(adm_task_t*);
+#ifdef __cplusplus
+}
+#endif
+
+/*===========================================================================*/
+/* Module inline functions.                                                  */
+/*===========================================================================*/
+
+#endif/* CH_CFG_USE_SS_ADMISSION */
+#endif/*CHADM_H*/
+/** @} */
@@ -136,27 +136,15 @@ struct ch_threads_queue {
 };
 
 /**
- * @brief   Aperiodic Request struct
+ * @brief   The user will refer to ApReq obj as AperiodicRequest
+ * @note    The structure is defined in chss.h
  */
-struct ApReq{
-  /**
-   * @brief pointer to the function
-   */
-  void (*fun_ptr)(void*);
-  /**
-   * @brief function parameter
-   */
-  void* arg;
-  /**
-   * @brief next aperiodic request in the list
-   */
-  struct ApReq* next;
-};
+typedef  struct ApReq AperiodicRequest;
 
 /**
- * @brief   The user will refer to ApReq obj as AperiodicRequest
+ * @brief   Type of a sporadic server object.
  */
-typedef  struct ApReq AperiodicRequest;
+typedef struct ch_sporadic_server sporadic_server_t;
 
 /**
  * @brief   Structure representing a thread.
@@ -330,51 +318,9 @@ struct ch_thread {
 #endif
 #if CH_CFG_USE_SS==TRUE
   /**
-   * @brief   Start of an instance of the sporadic server task
-   */
-  systime_t instance_start;
-  /**
-   * @brief   End of an instance of the sporadic server task
-   */
-  systime_t instance_end;
-  /**
-   * @brief   time consumed from the sporadic server
-   */
-  systime_t consumed_time;
-  /**
-   * @brief   actual capacity of the sporadic server
-   */
-  systime_t capacity;
-  /**
-   * @brief   maximum capacity of the sporadic server
-   */
-  systime_t maximum_capacity;
-  /**
-   * @brief   period of the sporadic server
-   */
-  systime_t period;
-  /**
-   * @brief   pointer to the FIFO queue of Aperiodic Requests
-   */
-  AperiodicRequest* requests;
-  /**
-   * @brief   Time where Pexe>=Psporadic && Capacity>0
-   */
-  systime_t TA;
-  /**
-   * @brief   Tells us that we must update TA
-   */
-  bool mustUpdateTA;
-  /**
-   * @brief   The number of time to be replinished , must be different from consumed time, consumed time is just the difference between end-start
-   *          updating capacity with consumed time is not possible because it must be resetted after updating capacity(if we don't do this the next capacity update , calling
-   *          the first (end -start ) first instance (and so the second instance ) will be capacity-(first+second)instances (instead of capacity -second instance)
-   */
-  systime_t timeToReplinish;
-  /*
-   * @brief flag added for isPreemptionRequired
+   * @brief   Sporadic server owning this thread or @p NULL.
    */
-  bool ending;
+  sporadic_server_t *ss;
 #endif /*CH_CFG_USE_SS*/
 };
 
@@ -34,65 +34,803 @@
 /* Module constants.                                                         */
 /*===========================================================================*/
 /*
- * @name Capacity Helper
+ * @name Sporadic Thd Constants
  * @{
  */
-#define TICK_BOUND 4294967295 /**<@brief:2^32-1, used to check if we are in a new clock cycle.  */
+#define SPORADIC_WA 256/*<@brief working area of the sporadic Server*/
 /** @} */
 /*
- * @name Replinishment constants
+ * @name Sporadic Thd dbg
  * @{
  */
-#define NUM_REP 256 /*<@brief number of replinishments in a replinishment array.    */
-#define NUM_TIM 10  /*<@brief number of timer that can be armed to manage replinishments.   */
+#define SPORADIC_DBG 256/*<@brief Sporadic DBG flg*/
+#define SPORADIC_DBG_SIZE 10/*<@brief Number of replinishments kept in the dbg array*/
 /** @} */
 /*
- * @name Sporadic Thd Constants
+ * @name Reclaiming modes, see chSporadicServerSetReclaim()
  * @{
  */
-#define SPORADIC_WA 256/*<@brief working area of the sporadic Server*/
+#define SS_RECLAIM_DONATE 1U/*<@brief The capacity left when the server goes idle is given to the spare pool*/
+#define SS_RECLAIM_BORROW 2U/*<@brief The server consumes the spare capacity before its own*/
 /** @} */
 /*
- * @name Sporadic Thd dbg
+ * @name States of a request waited with chSporadicServerSubmitAndWait()
  * @{
  */
-#define SPORADIC_DBG 256/*<@brief Sporadic DBG flg*/
+#define SS_AP_IDLE 0U/*<@brief The request is not queued*/
+#define SS_AP_QUEUED 1U/*<@brief The request is queued and no worker has started it*/
+#define SS_AP_STARTED 2U/*<@brief A worker has started the request, a continuation keeps this state*/
+#define SS_AP_DONE 3U/*<@brief The request has been completed*/
 /** @} */
 
 /*===========================================================================*/
 /* Module pre-compile time settings.                                         */
 /*===========================================================================*/
+/*
+ * @brief   Number of pending replinishments of a server.
+ * @note    Upper bound of the runtime limit set with chSporadicServerSetMaxRepl().
+ */
+#if !defined(NUM_REP)
+#define NUM_REP 16
+#endif
+/*
+ * @brief   Coalescing window of the replinishments, in system ticks.
+ * @note    A replinishment released within this window after the latest pending one is merged in it,
+ *          this bounds the rate of the replinishment timer under heavy preemption.
+ */
+#if !defined(SPORADIC_REP_MERGE)
+#define SPORADIC_REP_MERGE 0
+#endif
+
+/*
+ * @brief   Number of requests that can be submitted from ISR before the server thread runs.
+ */
+#if !defined(SPORADIC_RING_SIZE)
+#define SPORADIC_RING_SIZE 8
+#endif
+/*
+ * @brief   Budget accounting on the realtime counter.
+ * @note    If TRUE the consumed time, the capacity and the replinishments are kept in realtime counter cycles
+ *          instead of system ticks, this gives an exact enforcement for requests shorter than a tick.
+ * @note    Requires @p SPORADIC_RT_FREQUENCY, the frequency of the realtime counter.
+ */
+#if !defined(SPORADIC_RT_ACCOUNTING)
+#define SPORADIC_RT_ACCOUNTING FALSE
+#endif
+/*
+ * @brief   The time spent in the ISRs is not charged to the interrupted server.
+ * @note    Requires @p SPORADIC_RT_ACCOUNTING and the calls to __sporadicserver_irq_prologue() and
+ *          __sporadicserver_irq_epilogue() in CH_CFG_IRQ_PROLOGUE_HOOK and CH_CFG_IRQ_EPILOGUE_HOOK.
+ */
+#if !defined(SPORADIC_IRQ_ACCOUNTING)
+#define SPORADIC_IRQ_ACCOUNTING FALSE
+#endif
+
+/*
+ * @brief   Per request and per server timing statistics.
+ * @note    Requires @p CH_CFG_USE_TM, the times are measured in realtime counter cycles.
+ */
+#if !defined(SPORADIC_STATS)
+#define SPORADIC_STATS FALSE
+#endif
+/*
+ * @brief   Number of log2 bins of the statistics histograms.
+ */
+#if !defined(SPORADIC_STATS_BINS)
+#define SPORADIC_STATS_BINS 32
+#endif
+/*
+ * @brief   Number of request descriptors in the kernel pool, zero disables the pool.
+ * @note    A descriptor taken from the pool goes back to it when its function returns.
+ */
+#if !defined(SPORADIC_POOL_SIZE)
+#define SPORADIC_POOL_SIZE 0
+#endif
+/*
+ * @brief   Number of budget reservations that can be attached to ordinary threads, zero disables them.
+ */
+#if !defined(SPORADIC_RESERVATIONS)
+#define SPORADIC_RESERVATIONS 0
+#endif
+/*
+ * @brief   Measurement of the context switch hook, fast and slow path apart.
+ * @note    Requires @p CH_CFG_USE_TM, the times are measured in realtime counter cycles.
+ */
+#if !defined(SPORADIC_HOOK_STATS)
+#define SPORADIC_HOOK_STATS FALSE
+#endif
+/*
+ * @brief   Measurement of the queue insertion critical section against the queue depth.
+ * @note    Requires @p CH_CFG_USE_TM, the times are measured in realtime counter cycles.
+ * @note    Single, coalesced and chained insertions are all measured, a chain counts as one insertion.
+ */
+#if !defined(SPORADIC_INSERT_STATS)
+#define SPORADIC_INSERT_STATS FALSE
+#endif
+/*
+ * @brief   Number of log2 depth buckets of the insertion measurement, bucket i counts the depths in [2^i,2^(i+1)).
+ */
+#if !defined(SPORADIC_INSERT_BINS)
+#define SPORADIC_INSERT_BINS 8
+#endif
+/*
+ * @brief   Requests with an absolute deadline and deadline ordered (EDF) request queue.
+ * @note    The EDF order is enabled per server with chSporadicServerSetEDF(), the deadline misses are counted in any case.
+ */
+#if !defined(SPORADIC_EDF)
+#define SPORADIC_EDF FALSE
+#endif
+/*
+ * @brief   Number of service classes of the request queue, the class with the highest number is served first.
+ * @note    Each class has its own FIFO queue, a bitmap gives the highest non-empty class.
+ */
+#if !defined(SPORADIC_CLASSES)
+#define SPORADIC_CLASSES 1
+#endif
+/*
+ * @brief   Number of entries of the spare capacity pool used by the bandwidth reclaiming, zero disables the reclaiming.
+ * @note    Each entry keeps the capacity left by an idle server until the end of its period.
+ */
+#if !defined(SPORADIC_RECLAIM)
+#define SPORADIC_RECLAIM 0
+#endif
+/*
+ * @brief   Coalescing of the duplicated requests.
+ * @note    A request marked with chSporadicServerAperiodicSetUnique() is dropped if a unique request with the same
+ *          function and parameter is pending and not started yet.
+ */
+#if !defined(SPORADIC_COALESCE)
+#define SPORADIC_COALESCE FALSE
+#endif
+/*
+ * @brief   Number of hash buckets of the pending unique requests, a power of two.
+ * @note    The duplicate check scans a single bucket, the requests are hashed on the function and the parameter.
+ */
+#if !defined(SPORADIC_COALESCE_BUCKETS)
+#define SPORADIC_COALESCE_BUCKETS 8
+#endif
 
 /*===========================================================================*/
 /* Derived constants and error checks.                                       */
 /*===========================================================================*/
+#if (NUM_REP < 1) || (NUM_REP > 255)
+#error "NUM_REP must be in the range 1..255"
+#endif
+#if (SPORADIC_RING_SIZE < 1) || (SPORADIC_RING_SIZE > 255)
+#error "SPORADIC_RING_SIZE must be in the range 1..255"
+#endif
+#if (SPORADIC_CLASSES < 1) || (SPORADIC_CLASSES > 32)
+#error "SPORADIC_CLASSES must be in the range 1..32"
+#endif
+#if (SPORADIC_COALESCE_BUCKETS < 1) || (SPORADIC_COALESCE_BUCKETS > 256) || \
+    ((SPORADIC_COALESCE_BUCKETS & (SPORADIC_COALESCE_BUCKETS - 1)) != 0)
+#error "SPORADIC_COALESCE_BUCKETS must be a power of two in the range 1..256"
+#endif
+#if (SPORADIC_STATS == TRUE) && (CH_CFG_USE_TM == FALSE)
+#error "SPORADIC_STATS requires CH_CFG_USE_TM"
+#endif
+#if (SPORADIC_HOOK_STATS == TRUE) && (CH_CFG_USE_TM == FALSE)
+#error "SPORADIC_HOOK_STATS requires CH_CFG_USE_TM"
+#endif
+#if (SPORADIC_INSERT_STATS == TRUE) && (CH_CFG_USE_TM == FALSE)
+#error "SPORADIC_INSERT_STATS requires CH_CFG_USE_TM"
+#endif
+#if (SPORADIC_POOL_SIZE > 0) && (CH_CFG_USE_MEMPOOLS == FALSE)
+#error "SPORADIC_POOL_SIZE requires CH_CFG_USE_MEMPOOLS"
+#endif
+#if SPORADIC_RT_ACCOUNTING == TRUE
+#if PORT_SUPPORTS_RT == FALSE
+#error "SPORADIC_RT_ACCOUNTING requires PORT_SUPPORTS_RT"
+#endif
+#if !defined(SPORADIC_RT_FREQUENCY)
+#error "SPORADIC_RT_ACCOUNTING requires SPORADIC_RT_FREQUENCY"
+#endif
+#endif
+#if (SPORADIC_IRQ_ACCOUNTING == TRUE) && (SPORADIC_RT_ACCOUNTING == FALSE)
+#error "SPORADIC_IRQ_ACCOUNTING requires SPORADIC_RT_ACCOUNTING"
+#endif
 
 
 /*===========================================================================*/
 /* Module data structures and types.                                         */
 /*===========================================================================*/
 
+#if (SPORADIC_RT_ACCOUNTING == TRUE) || defined(__DOXYGEN__)
+/*
+ * @brief   Type of a budget, realtime counter cycles.
+ */
+typedef rtcnt_t ss_budget_t;
+/*
+ * @brief   Type of the time stamps used to measure the consumed budget.
+ */
+typedef rtcnt_t ss_stamp_t;
+#else
+typedef sysinterval_t ss_budget_t;
+typedef systime_t ss_stamp_t;
+#endif
+
+/**
+ * @brief   Aperiodic Request struct
+ */
+struct ApReq{
+  /**
+   * @brief pointer to the function
+   */
+  void (*fun_ptr)(void*);
+  /**
+   * @brief function parameter
+   */
+  void* arg;
+  /**
+   * @brief next aperiodic request in the list
+   */
+  struct ApReq* next;
+  /**
+   * @brief result of the request, set with chSporadicServerSetResult()
+   */
+  msg_t result;
+  /**
+   * @brief thread waiting for the completion, resumed with the result
+   */
+  thread_reference_t waiter;
+  /**
+   * @brief service class of the request, see SPORADIC_CLASSES
+   */
+  uint8_t cls;
+  /**
+   * @brief state of the request, SS_AP_IDLE, SS_AP_QUEUED, SS_AP_STARTED or SS_AP_DONE
+   */
+  uint8_t state;
+#if (SPORADIC_COALESCE == TRUE) || defined(__DOXYGEN__)
+  /**
+   * @brief the request is dropped if an identical unique request is pending
+   */
+  bool unique;
+  /**
+   * @brief next pending unique request of the server
+   */
+  struct ApReq* unext;
+#endif
+#if (SPORADIC_EDF == TRUE) || defined(__DOXYGEN__)
+  /**
+   * @brief absolute deadline, valid if @p timed
+   */
+  systime_t deadline;
+  /**
+   * @brief the request has a deadline, set with chSporadicServerAperiodicSetDeadline()
+   */
+  bool timed;
+  /**
+   * @brief first child in the deadline heap of the server, the siblings are linked through @p next
+   */
+  struct ApReq* child;
+  /**
+   * @brief left sibling in the deadline heap, or the parent for the first child
+   */
+  struct ApReq* prev;
+#endif
+#if (SPORADIC_POOL_SIZE > 0) || defined(__DOXYGEN__)
+  /**
+   * @brief the descriptor belongs to the kernel pool and is freed after its execution
+   */
+  bool pooled;
+#endif
+#if (CH_CFG_USE_SEMAPHORES == TRUE) || defined(__DOXYGEN__)
+  /**
+   * @brief semaphore signaled on completion or @p NULL
+   */
+  semaphore_t *sem;
+#endif
+#if (CH_CFG_USE_EVENTS == TRUE) || defined(__DOXYGEN__)
+  /**
+   * @brief event source broadcasted on completion or @p NULL
+   */
+  event_source_t *esp;
+  /**
+   * @brief flags broadcasted on completion
+   */
+  eventflags_t flags;
+#endif
+#if (SPORADIC_STATS == TRUE) || defined(__DOXYGEN__)
+  /**
+   * @brief realtime counter when the request has been queued
+   */
+  rtcnt_t enqueue_time;
+  /**
+   * @brief realtime counter when the server started the request
+   */
+  rtcnt_t start_time;
+  /**
+   * @brief realtime counter when the request has been completed
+   */
+  rtcnt_t end_time;
+  /**
+   * @brief budget charged to the server while executing the request
+   * @note  with more workers it includes the slices of the other workers in the same interval
+   */
+  ss_budget_t consumed;
+  /**
+   * @brief time spent blocked on a kernel object while executing the request
+   */
+  rtcnt_t blocked;
+#endif
+};
+
+#if (SPORADIC_STATS == TRUE) || defined(__DOXYGEN__)
+/*
+ * @brief   Aggregate statistics of a server, in realtime counter cycles.
+ * @note    The mean is cumulative/n of each measurement.
+ */
+typedef struct {
+  /*
+   * @brief   From the enqueue to the completion of the requests
+   */
+  time_measurement_t response;
+  /*
+   * @brief   From the start to the completion of the requests, including the blocked time
+   */
+  time_measurement_t exec;
+  /*
+   * @brief   Time spent blocked by the requests
+   */
+  time_measurement_t blocked;
+#if (SPORADIC_IRQ_ACCOUNTING == TRUE) || defined(__DOXYGEN__)
+  /*
+   * @brief   Budget spent in the ISRs and not charged to the server
+   */
+  ss_budget_t isr;
+#endif
+  /*
+   * @brief   Histogram of the response times, bin i counts the times in [2^i,2^(i+1))
+   */
+  ucnt_t response_hist[SPORADIC_STATS_BINS];
+  /*
+   * @brief   Histogram of the execution times
+   */
+  ucnt_t exec_hist[SPORADIC_STATS_BINS];
+} ss_stats_t;
+#endif
+
+/*
+ * @brief   A pending replinishment.
+ */
+typedef struct {
+  /*
+   * @brief   System time when the amount is given back to the server
+   */
+  systime_t time;
+  /*
+   * @brief   Capacity to be replinished
+   */
+  ss_budget_t amount;
+} ss_replinishment_t;
+
+/*
+ * @brief   Budget policy of a server.
+ * @note    The request queue, the thread and the consumed time accounting are shared by all the policies,
+ *          the hooks decide how the capacity is given back. The hooks are called with the kernel locked.
+ */
+typedef struct {
+  /*
+   * @brief   Called at the end of the object init, can be NULL
+   */
+  void (*init)(sporadic_server_t *ssp);
+  /*
+   * @brief   Called when the server thread enters the cpu
+   */
+  void (*switch_in)(sporadic_server_t *ssp);
+  /*
+   * @brief   Called when the server thread leaves the cpu, after the capacity update, can be NULL
+   */
+  void (*switch_out)(sporadic_server_t *ssp,ss_budget_t consumed);
+  /*
+   * @brief   Called when the capacity reaches zero
+   */
+  void (*exhausted)(sporadic_server_t *ssp);
+  /*
+   * @brief   Called by the replinishment timer
+   */
+  void (*replenish)(sporadic_server_t *ssp);
+  /*
+   * @brief   Called on every context switch, can be NULL
+   */
+  void (*schedule)(sporadic_server_t *ssp,const thread_t *ntp,const thread_t *otp);
+  /*
+   * @brief   Called when period and capacity are changed at runtime, after the capacity clamp, can be NULL
+   */
+  void (*reconfigure)(sporadic_server_t *ssp,sysinterval_t old_period);
+} ss_policy_t;
+
+/*
+ * @brief   Type of a worker thread of a server.
+ */
+typedef struct ss_worker ss_worker_t;
+
+/*
+ * @brief   Structure representing a worker thread of a server.
+ * @note    All the workers of a server take the requests from the same queue and consume the same capacity.
+ */
+struct ss_worker {
+  /*
+   * @brief   Next worker of the server
+   */
+  ss_worker_t *next;
+  /*
+   * @brief   Worker thread
+   */
+  thread_t *thread;
+  /*
+   * @brief   Request being executed by the worker or NULL
+   */
+  AperiodicRequest *current;
+  /*
+   * @brief   The worker has been removed from the ready list because the capacity is exhausted
+   */
+  bool parked;
+  /*
+   * @brief   The running request asked to be queued again with its continuation, see chSporadicServerRequeue()
+   */
+  bool requeue;
+#if (SPORADIC_STATS == TRUE) || defined(__DOXYGEN__)
+  /*
+   * @brief   The worker left the cpu blocked inside a request
+   */
+  bool blocked;
+  /*
+   * @brief   Realtime counter when the worker has been blocked
+   */
+  rtcnt_t blocked_since;
+#endif
+};
+
+/*
+ * @brief   Structure representing a sporadic server.
+ * @note    Each server owns its threads, its replinishments and its timers, so
+ *          more servers can coexist at different priorities.
+ */
+struct ch_sporadic_server {
+  /*
+   * @brief   Next server in the list of the active servers
+   */
+  sporadic_server_t *next;
+  /*
+   * @brief   First worker thread, created with the server
+   */
+  thread_t *thread;
+  /*
+   * @brief   First worker
+   */
+  ss_worker_t worker;
+  /*
+   * @brief   List of the workers, the first one included
+   */
+  ss_worker_t *workers;
+  /*
+   * @brief   Budget policy
+   */
+  const ss_policy_t *policy;
+  /*
+   * @brief   Priority of the server while it has capacity
+   */
+  tprio_t prio;
+  /*
+   * @brief   Priority of the server when the capacity is exhausted, NOPRIO if the server is suspended
+   */
+  tprio_t low_prio;
+  /*
+   * @brief   The server is running at low_prio without consuming budget
+   */
+  bool background;
+  /*
+   * @brief   Start of an instance of the sporadic server task
+   */
+  ss_stamp_t instance_start;
+  /*
+   * @brief   End of an instance of the sporadic server task
+   */
+  ss_stamp_t instance_end;
+  /*
+   * @brief   time consumed from the sporadic server
+   */
+  ss_budget_t consumed_time;
+  /*
+   * @brief   actual capacity of the sporadic server
+   */
+  ss_budget_t capacity;
+  /*
+   * @brief   maximum capacity of the sporadic server
+   */
+  ss_budget_t maximum_capacity;
+  /*
+   * @brief   period of the sporadic server
+   */
+  sysinterval_t period;
+#if CH_CFG_USE_SS_ADMISSION == TRUE
+  /*
+   * @brief   Server seen by the admission control as a periodic task (Cs,Ts)
+   */
+  adm_task_t adm;
+#endif
+  /*
+   * @brief   FIFO queues of Aperiodic Requests, one per service class
+   */
+  AperiodicRequest *requests[SPORADIC_CLASSES];
+  /*
+   * @brief   Number of workers executing a request
+   */
+  ucnt_t busy;
+  /*
+   * @brief   Last request of each FIFO queue, used for O(1) insertions
+   */
+  AperiodicRequest *requests_tail[SPORADIC_CLASSES];
+  /*
+   * @brief   Bit i is set if the queue of the class i is not empty
+   */
+  uint32_t class_map;
+#if (SPORADIC_COALESCE == TRUE) || defined(__DOXYGEN__)
+  /*
+   * @brief   Unique requests queued or in the ring and not started yet, hashed on the function and the parameter
+   */
+  AperiodicRequest *unique[SPORADIC_COALESCE_BUCKETS];
+  /*
+   * @brief   Number of requests dropped because an identical one was pending
+   */
+  ucnt_t coalesced;
+#endif
+  /*
+   * @brief   Number of requests in the queue
+   */
+  ucnt_t requests_cnt;
+#if (SPORADIC_EDF == TRUE) || defined(__DOXYGEN__)
+  /*
+   * @brief   Pairing heap of the requests with a deadline, the root is the earliest one
+   * @note    Used only in EDF mode, it is served before the FIFO queue that keeps the requests without a deadline
+   */
+  AperiodicRequest *edf_heap;
+  /*
+   * @brief   The requests are served in deadline order
+   */
+  bool edf;
+  /*
+   * @brief   Number of requests completed after their deadline
+   */
+  ucnt_t deadline_misses;
+#endif
+  /*
+   * @brief   Ring of the requests submitted from ISR, drained by the server thread
+   */
+  AperiodicRequest *ring[SPORADIC_RING_SIZE];
+  /*
+   * @brief   Index of the oldest request in the ring
+   */
+  uint8_t ring_rd;
+  /*
+   * @brief   Number of requests in the ring
+   */
+  uint8_t ring_cnt;
+  /*
+   * @brief   Number of requests rejected because the ring was full
+   */
+  ucnt_t ring_overflows;
+  /*
+   * @brief   High-water mark of the ring
+   */
+  ucnt_t ring_hwm;
+#if SPORADIC_STATS == TRUE
+  /*
+   * @brief   Total budget charged to the server
+   */
+  ss_budget_t charged;
+  /*
+   * @brief   Requests timing statistics
+   */
+  ss_stats_t stats;
+#endif
+  /*
+   * @brief   Time where Pexe>=Psporadic && Capacity>0, start of the current period for the periodic policies
+   */
+  systime_t TA;
+  /*
+   * @brief   Tells us that we must update TA
+   */
+  bool mustUpdateTA;
+  /*
+   * @brief   The amount of time to be replinished, see the notes on consumed_time
+   */
+  ss_budget_t timeToReplinish;
+  /*
+   * @brief   flag checked by chSchIsPreemptionRequired
+   */
+  bool ending;
+#if (SPORADIC_IRQ_ACCOUNTING == TRUE) || defined(__DOXYGEN__)
+  /*
+   * @brief   Time spent in the ISRs during the running slice, subtracted when the slice is charged
+   */
+  ss_budget_t isr_time;
+#endif
+  /*
+   * @brief   Ring of the pending replinishments, ordered by release time
+   * @note    Release times are TA+period and TA never goes back, so the
+   *          insertion in the tail keeps the ring ordered.
+   */
+  ss_replinishment_t rep_queue[NUM_REP];
+  /*
+   * @brief   Index of the earliest pending replinishment
+   */
+  uint8_t rep_head;
+  /*
+   * @brief   Number of pending replinishments
+   */
+  uint8_t rep_cnt;
+  /*
+   * @brief   Maximum number of pending replinishments (POSIX sched_ss_max_repl)
+   * @note    When the limit is reached the two closest replinishments are merged in the later one
+   */
+  uint8_t max_repl;
+#if (SPORADIC_RECLAIM > 0) || defined(__DOXYGEN__)
+  /*
+   * @brief   Reclaiming mode, SS_RECLAIM_DONATE and SS_RECLAIM_BORROW bits
+   */
+  uint8_t reclaim;
+#endif
+  /*
+   * @brief   VT armed for the earliest pending replinishment, or for the next period
+   */
+  virtual_timer_t rep_vt;
+  /*
+   * @brief   Virtual timer that calls the reservation CB
+   */
+  virtual_timer_t reservation_vt;
+  /*
+   * @brief   Expiration time of the reservation timer, valid while it is armed
+   */
+  systime_t reservation_deadline;
+#if SPORADIC_DBG
+  /*
+   * @brief   Last replinished amounts
+   */
+  ss_budget_t dbg_arr[SPORADIC_DBG_SIZE];
+  uint8_t dbg_arr_index;
+  /*
+   * @brief   Number of times the reservation CB has been called
+   */
+  uint32_t num_called;
+#endif
+#if (SPORADIC_INSERT_STATS == TRUE) || defined(__DOXYGEN__)
+  /*
+   * @brief   Length of the critical section of the queue insertion, per log2 bucket of the queue depth
+   */
+  time_measurement_t insert_tm[SPORADIC_INSERT_BINS];
+  /*
+   * @brief   Maximum queue depth seen by an insertion
+   */
+  ucnt_t insert_max_depth;
+#endif
+};
+
 /*===========================================================================*/
 /* Module macros.                                                            */
 /*===========================================================================*/
+/*
+ * @name Budget conversions
+ * @{
+ */
+#if (SPORADIC_RT_ACCOUNTING == TRUE) || defined(__DOXYGEN__)
+/*
+ * @brief   Current time stamp for the budget accounting.
+ */
+#define SS_GET_STAMP() chSysGetRealtimeCounterX()
+/*
+ * @brief   Budget consumed between two time stamps.
+ */
+#define SS_STAMP_DIFF(start,end) ((ss_budget_t)((end)-(start)))
+/*
+ * @brief   Interval to budget.
+ */
+#define SS_I2B(i) ((ss_budget_t)(((uint64_t)(i)*(uint64_t)SPORADIC_RT_FREQUENCY)/(uint64_t)CH_CFG_ST_FREQUENCY))
+/*
+ * @brief   Budget to interval, rounded up to the next tick.
+ */
+#define SS_B2I(b) ((sysinterval_t)((((uint64_t)(b)*(uint64_t)CH_CFG_ST_FREQUENCY)+(uint64_t)SPORADIC_RT_FREQUENCY-1ULL)/(uint64_t)SPORADIC_RT_FREQUENCY))
+#else
+#define SS_GET_STAMP() chVTGetSystemTimeX()
+#define SS_STAMP_DIFF(start,end) chTimeDiffX((start),(end))
+#define SS_I2B(i) ((ss_budget_t)(i))
+#define SS_B2I(b) ((sysinterval_t)(b))
+#endif
+/** @} */
+
+#if (SPORADIC_IRQ_ACCOUNTING == FALSE) && !defined(__DOXYGEN__)
+/*
+ * @name IRQ hooks, empty if the ISR time is charged
+ * @{
+ */
+#define __sporadicserver_irq_prologue()
+#define __sporadicserver_irq_epilogue()
+/** @} */
+#endif
 
 /*===========================================================================*/
 /* External declarations.                                                    */
 /*===========================================================================*/
 
+#if !defined(__DOXYGEN__)
+extern const ss_policy_t ss_policy_sporadic;
+extern const ss_policy_t ss_policy_deferrable;
+extern const ss_policy_t ss_policy_polling;
+extern tprio_t ss_watch_prio;
+extern ucnt_t ss_active_cnt;
+#endif
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
-  void __sporadicserver_updatetime(const thread_t*,const thread_t*);
-  thread_t* chSporadicServerObjectInit(systime_t ,systime_t,tprio_t);
-  AperiodicRequest* chSporadicServerCreateAperiodic(void* ,void*,AperiodicRequest*);
-  AperiodicRequest* chSporadicServerAperiodicQueueInsert(AperiodicRequest*);
-  AperiodicRequest* chSporadicServerAperiodicQueueInsertS(AperiodicRequest*);
-  bool chSporadicServerNeedWU(void);
-  thread_t* chSporadicServerGetInstance(void);
+  void _ss_init(void);
+  void __sporadicserver_updatetime_slow(const thread_t*,const thread_t*);
+#if SPORADIC_HOOK_STATS == TRUE
+  void __sporadicserver_hook_stats(bool,rtcnt_t);
+  void chSporadicServerGetHookStats(time_measurement_t*,time_measurement_t*);
+  void chSporadicServerResetHookStats(void);
+#endif
+#if SPORADIC_IRQ_ACCOUNTING == TRUE
+  void __sporadicserver_irq_prologue(void);
+  void __sporadicserver_irq_epilogue(void);
+#endif
+  thread_t* chSporadicServerObjectInit(sporadic_server_t*,void*,size_t,sysinterval_t,sysinterval_t,tprio_t,const ss_policy_t*);
+  thread_t* chSporadicServerAddWorker(sporadic_server_t*,ss_worker_t*,void*,size_t);
+  void chSporadicServerAperiodicObjectInit(AperiodicRequest*,void*,void*);
+  void chSporadicServerAperiodicSetClass(AperiodicRequest*,uint8_t);
+#if SPORADIC_COALESCE == TRUE
+  void chSporadicServerAperiodicSetUnique(AperiodicRequest*,bool);
+  ucnt_t chSporadicServerGetCoalesced(sporadic_server_t*);
+#endif
+  AperiodicRequest* chSporadicServerCreateAperiodic(sporadic_server_t*,void*,void*,AperiodicRequest*,uint8_t);
+  AperiodicRequest* chSporadicServerAperiodicQueueInsert(sporadic_server_t*,AperiodicRequest*);
+  AperiodicRequest* chSporadicServerAperiodicQueueInsertS(sporadic_server_t*,AperiodicRequest*);
+  ucnt_t chSporadicServerSubmitChainS(sporadic_server_t*,AperiodicRequest*,AperiodicRequest*,ucnt_t);
+  ucnt_t chSporadicServerSubmitBatch(sporadic_server_t*,AperiodicRequest*const[],ucnt_t);
+  msg_t chSporadicServerSubmitI(sporadic_server_t*,AperiodicRequest*);
+#if SPORADIC_POOL_SIZE > 0
+  AperiodicRequest* chSporadicServerAllocI(void);
+  AperiodicRequest* chSporadicServerAlloc(void);
+  void chSporadicServerFreeI(AperiodicRequest*);
+  msg_t chSporadicServerPostI(sporadic_server_t*,void*,void*);
+  msg_t chSporadicServerPost(sporadic_server_t*,void*,void*);
+#endif
+  msg_t chSporadicServerSubmitAndWait(sporadic_server_t*,AperiodicRequest*,sysinterval_t);
+  void chSporadicServerSetResult(msg_t);
+  bool chSporadicServerCheckpoint(sysinterval_t);
+  void chSporadicServerRequeue(void*,void*);
+#if SPORADIC_EDF == TRUE
+  void chSporadicServerAperiodicSetDeadline(AperiodicRequest*,systime_t);
+  void chSporadicServerSetEDF(sporadic_server_t*,bool);
+  ucnt_t chSporadicServerGetDeadlineMisses(sporadic_server_t*);
+#endif
+  void chSporadicServerGetRingStats(sporadic_server_t*,ucnt_t*,ucnt_t*);
+#if SPORADIC_STATS == TRUE
+  void chSporadicServerGetStats(sporadic_server_t*,ss_stats_t*);
+  void chSporadicServerResetStats(sporadic_server_t*);
+#endif
+  void chSporadicServerSetParametersS(sporadic_server_t*,sysinterval_t,sysinterval_t);
+  bool chSporadicServerSetParameters(sporadic_server_t*,sysinterval_t,sysinterval_t);
+  void chSporadicServerSetLowPriority(sporadic_server_t*,tprio_t);
+  void chSporadicServerSetMaxRepl(sporadic_server_t*,uint8_t);
+#if SPORADIC_RECLAIM > 0
+  void chSporadicServerSetReclaim(sporadic_server_t*,uint8_t);
+  ss_budget_t chSporadicServerGetSpare(sporadic_server_t*);
+#endif
+#if SPORADIC_RESERVATIONS > 0
+  sporadic_server_t* chThdSetReservation(thread_t*,sysinterval_t,sysinterval_t);
+  void chThdClearReservation(thread_t*);
+#endif
+  bool chSporadicServerNeedWU(sporadic_server_t*);
+  thread_t* chSporadicServerGetInstance(sporadic_server_t*);
 #if SPORADIC_DBG
-  void chSporadicServerGetTime(uint32_t*,uint32_t*,uint32_t*);
+  void chSporadicServerGetTime(sporadic_server_t*,uint8_t*,uint32_t*,uint32_t*);
+#endif
+#if SPORADIC_INSERT_STATS == TRUE
+  void chSporadicServerGetInsertStats(sporadic_server_t*,time_measurement_t*,ucnt_t*);
 #endif
 #ifdef __cplusplus
 }
@@ -102,6 +840,28 @@ extern "C" {
 /* Module inline functions.                                                  */
 /*===========================================================================*/
 
+/*
+ * @brief   Context Switch hook for the sporadic servers
+ * @note    Fast path, nothing has to be done if no worker is involved, no sporadic server is in an active
+ *          interval and the ntp can not start one, the switch is left to the slow path otherwise.
+ */
+static inline void __sporadicserver_updatetime(const thread_t *ntp,const thread_t *otp){
+#if SPORADIC_HOOK_STATS == TRUE
+  rtcnt_t start=chSysGetRealtimeCounterX();
+#endif
+
+  if((ntp->ss==NULL)&&(otp->ss==NULL)&&(ss_active_cnt==0U)&&(ntp->prio<ss_watch_prio)){
+#if SPORADIC_HOOK_STATS == TRUE
+    __sporadicserver_hook_stats(false,start);
+#endif
+    return;
+  }
+  __sporadicserver_updatetime_slow(ntp,otp);
+#if SPORADIC_HOOK_STATS == TRUE
+  __sporadicserver_hook_stats(true,start);
+#endif
+}
+
 #endif/* CH_CFG_USE_SS */
 #endif/*CHSS_H*/
 /** @} */
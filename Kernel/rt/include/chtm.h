@@ -94,6 +94,8 @@ extern "C" {
   NOINLINE void chTMStopMeasurementX(time_measurement_t *tmp);
   NOINLINE void chTMChainMeasurementToX(time_measurement_t *tmp1,
                                         time_measurement_t *tmp2);
+  void chTMAddMeasurementX(time_measurement_t *tmp,
+                           rtcnt_t start, rtcnt_t end);
 #ifdef __cplusplus
 }
 #endif
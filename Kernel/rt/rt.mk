@@ -50,6 +50,9 @@ endif
 ifneq ($(findstring CH_CFG_USE_SS TRUE,$(CHCONF)),)
 KERNSRC += $(CHIBIOS)/os/rt/src/chss.c
 endif
+ifneq ($(findstring CH_CFG_USE_SS_ADMISSION TRUE,$(CHCONF)),)
+KERNSRC += $(CHIBIOS)/os/rt/src/chadm.c
+endif
 else
 KERNSRC := $(CHIBIOS)/os/rt/src/chsys.c \
            $(CHIBIOS)/os/rt/src/chdebug.c \
@@ -66,7 +69,8 @@ KERNSRC := $(CHIBIOS)/os/rt/src/chsys.c \
            $(CHIBIOS)/os/rt/src/chevents.c \
            $(CHIBIOS)/os/rt/src/chmsg.c \
            $(CHIBIOS)/os/rt/src/chdynamic.c \
-           $(CHIBIOS)/os/rt/src/chss.c
+           $(CHIBIOS)/os/rt/src/chss.c \
+           $(CHIBIOS)/os/rt/src/chadm.c
 endif
 
 # Required include directories
@@ -0,0 +1,291 @@
+/*
+    ChibiOS - Copyright (C) 2006..2018 Giovanni Di Sirio.
+    This file is part of ChibiOS.
+    ChibiOS is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+    ChibiOS is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/*
+    This file is not part of the original ChibiOs 191.
+    Copyright (C) 2021 Antonio Emmanuele.
+*/
+/**
+ * @file    chadm.c
+ * @brief   Admission control module code.
+ *
+ * @addtogroup Admission
+ * @{
+ */
+
+#include "ch.h"
+
+#if (CH_CFG_USE_SS_ADMISSION==TRUE)
+/*===========================================================================*/
+/* Module local definitions.                                                 */
+/*===========================================================================*/
+/*
+ * @brief   Number of entries of the Liu-Layland bound table
+ */
+#define ADM_LL_SIZE 10U
+/*
+ * @brief   ln(2) in Q16, limit of the Liu-Layland bound
+ */
+#define ADM_LL_LIMIT 45426U
+
+/*===========================================================================*/
+/* Module exported variables.                                                */
+/*===========================================================================*/
+
+/*===========================================================================*/
+/* Module local types.                                                       */
+/*===========================================================================*/
+
+/*===========================================================================*/
+/* Module local variables.                                                   */
+/*===========================================================================*/
+/*
+ * @brief   Set of the admitted tasks
+ */
+static adm_task_t *adm_list;
+/*
+ * @brief   Mutex protecting the admitted set, the analysis runs outside the kernel lock
+ */
+static MUTEX_DECL(adm_mtx);
+/*
+ * @brief   Liu-Layland bound n(2^(1/n)-1) in Q16, indexed by n-1
+ */
+static const uint32_t adm_ll_bound[ADM_LL_SIZE]={
+  65536U,54292U,51103U,49600U,48725U,48154U,47751U,47452U,47221U,47037U
+};
+
+/*===========================================================================*/
+/* Module local functions.                                                   */
+/*===========================================================================*/
+/*
+ * @brief   Priority of a task used by the analysis
+ * @note    The real priority is used, a thread boosted by a mutex keeps its nominal priority
+ */
+static inline tprio_t __admPrio(const adm_task_t *atp){
+  return (atp->tp!=NULL) ? atp->tp->realprio : atp->prio;
+}
+/*
+ * @brief   Response time analysis of a single task against the admitted set
+ * @note    w = Ci + sum(ceil((w+Jj)/Tj)*Cj) over the tasks with greater or equal priority,
+ *          the iteration stops as soon as w+Ji exceeds the deadline.
+ * @ret     true if the worst case response time is within the deadline
+ */
+static bool __admTaskRta(const adm_task_t *atp){
+  const adm_task_t *jtp;
+  tprio_t prio=__admPrio(atp);
+  uint64_t w=atp->wcet,next;
+
+  for(;;){
+    if(w+atp->jitter>atp->deadline)
+      return false;
+    next=atp->wcet;
+    for(jtp=adm_list;jtp!=NULL;jtp=jtp->next){
+      if((jtp!=atp) && (__admPrio(jtp)>=prio))
+        next+=((w+jtp->jitter+jtp->period-1U)/jtp->period)*jtp->wcet;
+    }
+    if(next==w)
+      return true;
+    w=next;
+  }
+}
+/*
+ * @brief   Response time analysis of the admitted set
+ */
+static bool __admRta(void){
+  const adm_task_t *atp;
+
+  for(atp=adm_list;atp!=NULL;atp=atp->next){
+    if(!__admTaskRta(atp))
+      return false;
+  }
+  return true;
+}
+/*
+ * @brief   Liu-Layland test of the admitted set
+ * @note    The density C/D is used, the bound is sufficient only, it may reject a schedulable set.
+ */
+static bool __admUtilization(void){
+  const adm_task_t *atp;
+  uint64_t u=0;
+  uint32_t n=0;
+
+  for(atp=adm_list;atp!=NULL;atp=atp->next){
+    u+=(((uint64_t)atp->wcet<<16)+atp->deadline-1U)/atp->deadline;
+    n++;
+  }
+  if(n==0U)
+    return true;
+  return u<=((n<=ADM_LL_SIZE) ? adm_ll_bound[n-1U] : ADM_LL_LIMIT);
+}
+/*
+ * @brief   Selected schedulability test
+ */
+static inline bool __admTest(void){
+#if SS_ADMISSION_RTA == TRUE
+  return __admRta();
+#else
+  return __admUtilization();
+#endif
+}
+/*
+ * @brief   Links a task in the set
+ */
+static void __admLink(adm_task_t *atp){
+  atp->next=adm_list;
+  adm_list=atp;
+}
+/*
+ * @brief   Unlinks a task from the set
+ */
+static void __admUnlink(adm_task_t *atp){
+  adm_task_t **pp=&adm_list;
+
+  while(*pp!=NULL){
+    if(*pp==atp){
+      *pp=atp->next;
+      atp->next=NULL;
+      return;
+    }
+    pp=&(*pp)->next;
+  }
+}
+/*
+ * @brief   Runs a test on the admitted set plus an optional candidate, not changing the set
+ */
+static bool __admTestWith(adm_task_t *atp,bool (*test)(void)){
+  bool ok;
+
+  chMtxLock(&adm_mtx);
+  if((atp!=NULL) && !atp->admitted){
+    __admLink(atp);
+    ok=test();
+    __admUnlink(atp);
+  }
+  else
+    ok=test();
+  chMtxUnlock(&adm_mtx);
+  return ok;
+}
+
+/*===========================================================================*/
+/* Module exported functions.                                                */
+/*===========================================================================*/
+/*
+ * @brief   Inits an admission task
+ * @par_in  task object, thread or NULL, wcet, period and relative deadline in ticks, a zero deadline means implicit deadline
+ * @note    A task with a NULL thread uses the @p prio field, set it before the admission.
+ * @post    The task is not admitted and has no jitter
+ */
+void chAdmTaskObjectInit(adm_task_t *atp,thread_t *tp,sysinterval_t wcet,sysinterval_t period,sysinterval_t deadline){
+  chDbgCheck((atp!=NULL) && (period>(sysinterval_t)0) && (wcet<=period) && (deadline<=period));
+
+  atp->next=NULL;
+  atp->tp=tp;
+  atp->prio=(tp!=NULL) ? tp->realprio : NORMALPRIO;
+  atp->wcet=wcet;
+  atp->period=period;
+  atp->deadline=(deadline==(sysinterval_t)0) ? period : deadline;
+  atp->jitter=0;
+  atp->admitted=false;
+}
+/*
+ * @brief   Admits a task if the set stays schedulable
+ * @ret     true if admitted, false if the set would not be schedulable
+ * @note    Must be called from thread context, the set is protected by a mutex
+ */
+bool chAdmTaskAdmit(adm_task_t *atp){
+  bool ok;
+
+  chDbgCheck((atp!=NULL) && (atp->period>(sysinterval_t)0));
+
+  chMtxLock(&adm_mtx);
+  chDbgAssert(!atp->admitted,"already admitted");
+  __admLink(atp);
+  ok=__admTest();
+  if(ok)
+    atp->admitted=true;
+  else
+    __admUnlink(atp);
+  chMtxUnlock(&adm_mtx);
+  return ok;
+}
+/*
+ * @brief   Changes the parameters of a task, re-running the admission if the task is admitted
+ * @par_in  task, new wcet, period, deadline and jitter, a zero deadline means implicit deadline
+ * @ret     true if changed, false if the set would not be schedulable, in this case the old parameters are kept
+ */
+bool chAdmTaskChange(adm_task_t *atp,sysinterval_t wcet,sysinterval_t period,sysinterval_t deadline,sysinterval_t jitter){
+  sysinterval_t old_wcet,old_period,old_deadline,old_jitter;
+  bool ok=true;
+
+  chDbgCheck((atp!=NULL) && (period>(sysinterval_t)0) && (wcet<=period) && (deadline<=period));
+
+  chMtxLock(&adm_mtx);
+  old_wcet=atp->wcet;
+  old_period=atp->period;
+  old_deadline=atp->deadline;
+  old_jitter=atp->jitter;
+  atp->wcet=wcet;
+  atp->period=period;
+  atp->deadline=(deadline==(sysinterval_t)0) ? period : deadline;
+  atp->jitter=jitter;
+  if(atp->admitted){
+    ok=__admTest();
+    if(!ok){
+      atp->wcet=old_wcet;
+      atp->period=old_period;
+      atp->deadline=old_deadline;
+      atp->jitter=old_jitter;
+    }
+  }
+  chMtxUnlock(&adm_mtx);
+  return ok;
+}
+/*
+ * @brief   Removes a task from the admitted set, releasing its share
+ */
+void chAdmTaskRemove(adm_task_t *atp){
+
+  chDbgCheck(atp!=NULL);
+
+  chMtxLock(&adm_mtx);
+  if(atp->admitted){
+    __admUnlink(atp);
+    atp->admitted=false;
+  }
+  chMtxUnlock(&adm_mtx);
+}
+/*
+ * @brief   Checks the admitted set with the selected test
+ * @note    Useful after a priority change of an admitted thread
+ */
+bool chAdmIsSchedulable(void){
+  return __admTestWith(NULL,__admTest);
+}
+/*
+ * @brief   Response time analysis of the admitted set plus an optional candidate
+ * @note    The candidate is not admitted, NULL checks the admitted set only
+ */
+bool chAdmResponseTimeTest(adm_task_t *atp){
+  return __admTestWith(atp,__admRta);
+}
+/*
+ * @brief   Liu-Layland test of the admitted set plus an optional candidate
+ * @note    The candidate is not admitted, NULL checks the admitted set only
+ */
+bool chAdmUtilizationTest(adm_task_t *atp){
+  return __admTestWith(atp,__admUtilization);
+}
+#endif/*CH_CFG_USE_SS_ADMISSION*/
+/** @} */
@@ -481,10 +481,10 @@ void chSchRescheduleS(void) {
  * @special
  */
 bool chSchIsPreemptionRequired(void) {
-#if defined(CH_CFG_USE_SS)
-  if(currp==chSporadicServerGetInstance()){
-    if(currp->ending){
-      currp->ending=false;
+#if CH_CFG_USE_SS==TRUE
+  if(currp->ss!=NULL){
+    if(currp->ss->ending){
+      currp->ss->ending=false;
       return true;
     }
   }
@@ -34,358 +34,2445 @@
 /*===========================================================================*/
 /* Module exported variables.                                                */
 /*===========================================================================*/
+/*
+ * @brief   Lowest priority of the sporadic policy servers, a thread below it can not start an active interval
+ */
+tprio_t ss_watch_prio;
+/*
+ * @brief   Number of sporadic policy servers in an active interval
+ */
+ucnt_t ss_active_cnt;
 
 /*===========================================================================*/
 /* Module local types.                                                       */
 /*===========================================================================*/
+#if SPORADIC_RECLAIM > 0
+/*
+ * @brief   Capacity left by an idle server, it can be borrowed until the end of the period of the donor
+ */
+typedef struct {
+  /*
+   * @brief   Server that gave the capacity, NULL if the entry is free
+   */
+  sporadic_server_t *donor;
+  /*
+   * @brief   End of the period of the donor, the capacity is lost after it
+   */
+  systime_t deadline;
+  /*
+   * @brief   Capacity not borrowed yet
+   */
+  ss_budget_t amount;
+} ss_spare_t;
+#endif
+
+/*===========================================================================*/
+/* Module local variables.                                                   */
+/*===========================================================================*/
+
+/*
+ * @brief   List of the initialized sporadic servers
+ */
+static sporadic_server_t *ss_list;
+#if SPORADIC_POOL_SIZE > 0
+/*
+ * @brief   Pool of the request descriptors
+ */
+static memory_pool_t ss_pool;
+/*
+ * @brief   Storage of the pool
+ */
+static AperiodicRequest ss_pool_buf[SPORADIC_POOL_SIZE];
+#endif
+#if SPORADIC_RESERVATIONS > 0
+/*
+ * @brief   Servers used as reservations of ordinary threads, a free one has no thread
+ */
+static sporadic_server_t ss_res[SPORADIC_RESERVATIONS];
+#endif
+#if SPORADIC_IRQ_ACCOUNTING == TRUE
+/*
+ * @brief   ISR nesting level
+ */
+static ucnt_t ss_irq_nest;
+/*
+ * @brief   Server interrupted by the outermost ISR, NULL if no server was charging its budget
+ */
+static sporadic_server_t *ss_irq_server;
+/*
+ * @brief   Time stamp of the outermost ISR entry
+ */
+static ss_stamp_t ss_irq_start;
+#endif
+#if SPORADIC_RECLAIM > 0
+/*
+ * @brief   Spare capacity pool
+ */
+static ss_spare_t ss_spare[SPORADIC_RECLAIM];
+#endif
+#if SPORADIC_HOOK_STATS == TRUE
+/*
+ * @brief   Duration of the context switch hook, fast and slow path
+ */
+static time_measurement_t ss_hook_tm[2];
+#endif
+/*===========================================================================*/
+/* Module local functions.                                                   */
+/*===========================================================================*/
+static void __SporadicServerReplinishmentCB(void*arg);
+static void __SporadicServerReservationCB(void*arg);
+static ss_budget_t __ssBudgetLeft(sporadic_server_t *ssp);
+static void __ssCharge(sporadic_server_t *ssp,ss_stamp_t end);
+/*
+ * @brief   Checks if the server has pending requests, queued or submitted from ISR
+ */
+static inline bool __ssHasWork(sporadic_server_t *ssp){
+  return (ssp->requests_cnt>0U) || (ssp->ring_cnt>0U) || (ssp->busy>0U);
+}
+/*
+ * @brief   Checks if the server can be woken up, with some capacity left or in background
+ */
+static inline bool __ssCanRun(sporadic_server_t *ssp){
+  return (__ssBudgetLeft(ssp)>0) || ssp->background;
+}
+/*
+ * @brief   Checks if a worker of the server is running
+ */
+static inline bool __ssIsRunning(sporadic_server_t *ssp){
+  return currp->ss==ssp;
+}
+/*
+ * @brief   Worker of the server running on a thread
+ * @pre     the thread must be a worker of the server
+ */
+static ss_worker_t* __ssWorkerOf(sporadic_server_t *ssp,const thread_t *tp){
+  ss_worker_t *wp=ssp->workers;
+  while((wp!=NULL)&&(wp->thread!=tp))
+    wp=wp->next;
+  return wp;
+}
+/*
+ * @brief   Changes the priority of the server threads, moving them in the ready list if needed
+ * @note    As in chThdSetPriority() a worker boosted by a mutex keeps the boost
+ */
+static void __ssChangePrio(sporadic_server_t *ssp,tprio_t prio){
+  ss_worker_t *wp;
+  thread_t *tp;
+  for(wp=ssp->workers;wp!=NULL;wp=wp->next){
+    tp=wp->thread;
+#if CH_CFG_USE_MUTEXES == TRUE
+    if((tp->prio!=tp->realprio)&&(prio<=tp->prio)){
+      tp->realprio=prio;
+      continue;
+    }
+    tp->realprio=prio;
+#endif
+    if(tp->state==CH_STATE_READY){
+      (void)queue_dequeue(tp);
+      tp->prio=prio;
+      queue_prio_insert(tp,&ch.rlist.queue);
+    }
+    else
+      tp->prio=prio;
+  }
+}
+/*
+ * @brief   Drops an exhausted server to its background priority (POSIX sched_ss_low_priority)
+ * @note    Nothing is charged in background, the server keeps running in slack time until the next replinishment
+ */
+static void __ssBackground(sporadic_server_t *ssp){
+  ssp->background=true;
+  __ssChangePrio(ssp,ssp->low_prio);
+}
+/*
+ * @brief   Wakes up to n idle workers
+ * @note    An idle worker has no request and sleeps in the server loop, a worker blocked inside a request is never touched
+ */
+static void __ssWakeIdle(sporadic_server_t *ssp,ucnt_t n){
+  ss_worker_t *wp;
+  for(wp=ssp->workers;(wp!=NULL)&&(n>0U);wp=wp->next){
+    if((wp->current==NULL)&&!wp->parked&&
+       (wp->thread->state==CH_STATE_SLEEPING||wp->thread->state==CH_STATE_WTSTART)){
+      chSchReadyI(wp->thread);
+      n--;
+    }
+  }
+}
+/*
+ * @brief   Puts back in the ready list the workers parked on exhaustion and wakes up the idle ones for the queued requests
+ */
+static void __ssResume(sporadic_server_t *ssp){
+  ss_worker_t *wp;
+  for(wp=ssp->workers;wp!=NULL;wp=wp->next){
+    if(wp->parked){
+      wp->parked=false;
+      chSchReadyI(wp->thread);
+    }
+  }
+  __ssWakeIdle(ssp,ssp->requests_cnt+ssp->ring_cnt);
+}
+/*
+ * @brief   Checks if a time is strictly before another one
+ * @note    The system time wraps, the two times must be less than half of the range apart
+ */
+static inline bool __ssTimeBefore(systime_t a,systime_t b){
+  sysinterval_t d=chTimeDiffX(a,b);
+  return (d!=(sysinterval_t)0) && (d<=(sysinterval_t)(TIME_MAX_SYSTIME/2U));
+}
+#if SPORADIC_EDF == TRUE
+/*
+ * @brief   Melds two deadline heaps, the root with the later deadline becomes the first child of the other one
+ * @ret     the root of the melded heap
+ */
+static AperiodicRequest* __apHeapMeld(AperiodicRequest*a,AperiodicRequest*b){
+  AperiodicRequest *t;
+  if(a==0)
+    return b;
+  if(b==0)
+    return a;
+  if(__ssTimeBefore(b->deadline,a->deadline)){
+    t=a;
+    a=b;
+    b=t;
+  }
+  b->next=a->child;
+  if(a->child!=0)
+    a->child->prev=b;
+  b->prev=a;
+  a->child=b;
+  return a;
+}
+/*
+ * @brief   Melds a list of sibling heaps linked through @p next, in pairs from the left and the pairs from the right
+ * @ret     the root of the melded heap
+ */
+static AperiodicRequest* __apHeapPairs(AperiodicRequest*list){
+  AperiodicRequest *pairs=0,*heap=0,*a,*b;
+  while(list!=0){
+    a=list;
+    b=a->next;
+    list=(b!=0) ? b->next : 0;
+    a->next=0;
+    if(b!=0)
+      b->next=0;
+    a=__apHeapMeld(a,b);
+    a->next=pairs;
+    pairs=a;
+  }
+  while(pairs!=0){
+    a=pairs;
+    pairs=a->next;
+    a->next=0;
+    heap=__apHeapMeld(heap,a);
+  }
+  return heap;
+}
+/*
+ * @brief   Inserts a request in the deadline heap
+ * @note    O(1)
+ */
+static inline void __apHeapInsert(sporadic_server_t *ssp,AperiodicRequest*ap){
+  ap->next=0;
+  ap->child=0;
+  ssp->edf_heap=__apHeapMeld(ssp->edf_heap,ap);
+}
+/*
+ * @brief   Removes the earliest deadline request from the heap
+ * @note    O(log n) amortized, the children are melded in pairs from the left and the pairs from the right
+ * @pre     the heap must not be empty
+ */
+static AperiodicRequest* __apHeapRemove(sporadic_server_t *ssp){
+  AperiodicRequest *ap=ssp->edf_heap;
+  ssp->edf_heap=__apHeapPairs(ap->child);
+  ap->child=0;
+  return ap;
+}
+/*
+ * @brief   Removes a request from any position of the deadline heap
+ * @note    O(log n) amortized, the subtree of the request is melded again with the root
+ * @pre     the request must be in the heap
+ */
+static void __apHeapUnlink(sporadic_server_t *ssp,AperiodicRequest*ap){
+  AperiodicRequest *sub;
+  if(ap==ssp->edf_heap){
+    (void)__apHeapRemove(ssp);
+    return;
+  }
+  if(ap->prev->child==ap)
+    ap->prev->child=ap->next;
+  else
+    ap->prev->next=ap->next;
+  if(ap->next!=0)
+    ap->next->prev=ap->prev;
+  ap->next=0;
+  sub=__apHeapPairs(ap->child);
+  ap->child=0;
+  ssp->edf_heap=__apHeapMeld(ssp->edf_heap,sub);
+}
+#endif
+/*
+ * @brief   Highest non-empty service class
+ * @pre     at least one class must not be empty
+ */
+static inline uint32_t __apClassTop(sporadic_server_t *ssp){
+#if SPORADIC_CLASSES > 1
+  return 31U-(uint32_t)__builtin_clz(ssp->class_map);
+#else
+  (void)ssp;
+  return 0U;
+#endif
+}
+/*
+ * @brief   Links a NULL terminated chain of requests in the tail of the FIFO queue of a class
+ * @note    O(1)
+ */
+static inline void __apFifoSplice(sporadic_server_t *ssp,uint32_t cls,AperiodicRequest*first,AperiodicRequest*last){
+  if(ssp->requests[cls]==0){
+    ssp->requests[cls]=first;
+    ssp->class_map|=(uint32_t)1U<<cls;
+  }
+  else
+    ssp->requests_tail[cls]->next=first;
+  ssp->requests_tail[cls]=last;
+}
+/*
+ * @brief   Links a request in the tail of the FIFO queue of its class
+ * @note    O(1), in EDF mode a request with a deadline goes in the deadline heap
+ */
+static inline void __apQueueAppend(sporadic_server_t *ssp,AperiodicRequest*ap){
+#if SPORADIC_EDF == TRUE
+  if(ssp->edf&&ap->timed){
+    __apHeapInsert(ssp,ap);
+    ssp->requests_cnt++;
+    return;
+  }
+#endif
+  ap->next=0;
+  __apFifoSplice(ssp,ap->cls,ap,ap);
+  ssp->requests_cnt++;
+}
+/*
+ * @brief   Budget consumed by the running slice, not yet charged
+ * @note    Called from an ISR, as the reservation CB, the ISR in progress is not counted, the switch out at its exit
+ *          does not charge it either. Otherwise the CB could preempt a server that the charge leaves with some capacity,
+ *          and the server would stay ready while a lower priority thread runs.
+ * @pre     a worker of the server is running and the server is not in background
+ */
+static ss_budget_t __ssSliceNow(sporadic_server_t *ssp){
+  ss_stamp_t now=SS_GET_STAMP();
+  ss_budget_t slice=SS_STAMP_DIFF(ssp->instance_start,now);
+#if SPORADIC_IRQ_ACCOUNTING == TRUE
+  ss_budget_t isr=ssp->isr_time;
+  if((ss_irq_nest>0U)&&(ss_irq_server==ssp))
+    isr+=SS_STAMP_DIFF(ss_irq_start,now);
+  if(isr>slice)
+    return 0;
+  slice-=isr;
+#endif
+  return slice;
+}
+#if SPORADIC_RECLAIM > 0
+/*
+ * @brief   Spare capacity of an entry that a server can borrow now
+ * @note    Only the capacity of a donor with a priority not lower than the borrower is seen, so the borrower does not
+ *          interfere with a task more than the donor would have done. The capacity is also bounded by the time left
+ *          to the deadline, the reservation timer of the borrower never goes past it.
+ */
+static ss_budget_t __ssSpareOf(sporadic_server_t *ssp,const ss_spare_t *sp,systime_t now){
+  ss_budget_t left;
+  if((sp->donor==NULL)||(sp->amount==0)||(sp->donor->prio<ssp->prio)||!__ssTimeBefore(now,sp->deadline))
+    return 0;
+  left=SS_I2B(chTimeDiffX(now,sp->deadline));
+  return (sp->amount<left) ? sp->amount : left;
+}
+/*
+ * @brief   Spare capacity that a server can borrow now
+ */
+static ss_budget_t __ssSpareAvail(sporadic_server_t *ssp){
+  systime_t now=chVTGetSystemTimeX();
+  ss_budget_t sum=0;
+  for(uint32_t i=0;i<SPORADIC_RECLAIM;i++)
+    sum+=__ssSpareOf(ssp,&ss_spare[i],now);
+  return sum;
+}
+/*
+ * @brief   Charges a slice to the spare pool, the earliest deadline first
+ * @ret     the part of the slice that must be charged to the own capacity
+ */
+static ss_budget_t __ssSpareTake(sporadic_server_t *ssp,ss_budget_t slice){
+  systime_t now=chVTGetSystemTimeX();
+  ss_spare_t *sp;
+  ss_budget_t avail,take;
+  while(slice>0){
+    sp=NULL;
+    for(uint32_t i=0;i<SPORADIC_RECLAIM;i++){
+      if((__ssSpareOf(ssp,&ss_spare[i],now)>0)&&((sp==NULL)||__ssTimeBefore(ss_spare[i].deadline,sp->deadline)))
+        sp=&ss_spare[i];
+    }
+    if(sp==NULL)
+      break;
+    avail=__ssSpareOf(ssp,sp,now);
+    take=(slice<avail) ? slice : avail;
+    sp->amount-=take;
+    slice-=take;
+    if(sp->amount==0)
+      sp->donor=NULL;
+  }
+  return slice;
+}
+/*
+ * @brief   Gives the capacity left by an idle server to the spare pool
+ * @note    Called by the last worker going to sleep, the running slice is kept to be charged at the switch out.
+ *          The borrowers parked on exhaustion that can see the spare capacity are put back in the ready list.
+ * @pre     periodic policy, the capacity is lost at the end of the period anyway
+ */
+static void __ssDonate(sporadic_server_t *ssp){
+  systime_t now=chVTGetSystemTimeX();
+  ss_budget_t slice=__ssSliceNow(ssp);
+  sporadic_server_t *bsp;
+  ss_spare_t *sp=NULL;
+
+  if(ssp->background||(slice>=ssp->capacity))
+    return;
+  for(uint32_t i=0;i<SPORADIC_RECLAIM;i++){
+    if((ss_spare[i].donor==NULL)||!__ssTimeBefore(now,ss_spare[i].deadline)){
+      sp=&ss_spare[i];
+      break;
+    }
+  }
+  /* Pool full, the capacity is lost as without the reclaiming*/
+  if(sp==NULL)
+    return;
+  sp->donor=ssp;
+  sp->deadline=ssp->TA+ssp->period;
+  sp->amount=ssp->capacity-slice;
+  ssp->capacity=slice;
+  for(bsp=ss_list;bsp!=NULL;bsp=bsp->next){
+    if((bsp!=ssp)&&(bsp->reclaim&SS_RECLAIM_BORROW)&&!bsp->background&&(bsp->capacity==0)&&(bsp->prio<=ssp->prio))
+      __ssResume(bsp);
+  }
+}
+#endif
+/*
+ * @brief   Budget the server can consume now, its capacity plus the spare capacity it can borrow
+ */
+static ss_budget_t __ssBudgetLeft(sporadic_server_t *ssp){
+#if SPORADIC_RECLAIM > 0
+  if(ssp->reclaim&SS_RECLAIM_BORROW)
+    return ssp->capacity+__ssSpareAvail(ssp);
+#endif
+  return ssp->capacity;
+}
+#if SPORADIC_STATS == TRUE
+/*
+ * @brief   Budget charged to the server so far, including the running slice
+ * @pre     called by the server thread
+ */
+static ss_budget_t __ssChargedNow(sporadic_server_t *ssp){
+  if(ssp->background)
+    return ssp->charged;
+  return ssp->charged+__ssSliceNow(ssp);
+}
+/*
+ * @brief   Adds a time to a log2 histogram
+ */
+static void __ssHistAdd(ucnt_t *hist,rtcnt_t t){
+  uint32_t b=0;
+  while(t>1U && b<SPORADIC_STATS_BINS-1U){
+    t>>=1;
+    b++;
+  }
+  hist[b]++;
+}
+/*
+ * @brief   Inits the statistics of the server
+ */
+static void __ssStatsInit(ss_stats_t *sp){
+  chTMObjectInit(&sp->response);
+  chTMObjectInit(&sp->exec);
+  chTMObjectInit(&sp->blocked);
+#if SPORADIC_IRQ_ACCOUNTING == TRUE
+  sp->isr=0;
+#endif
+  for(uint32_t i=0;i<SPORADIC_STATS_BINS;i++){
+    sp->response_hist[i]=0;
+    sp->exec_hist[i]=0;
+  }
+}
+/*
+ * @brief   Completes the statistics of a request and updates the aggregate ones
+ * @pre     consumed must contain the budget charged when the request has been started
+ */
+static void __ssStatsUpdate(sporadic_server_t *ssp,AperiodicRequest*ap){
+  ap->end_time=chSysGetRealtimeCounterX();
+  ap->consumed=__ssChargedNow(ssp)-ap->consumed;
+  chTMAddMeasurementX(&ssp->stats.response,ap->enqueue_time,ap->end_time);
+  chTMAddMeasurementX(&ssp->stats.exec,ap->start_time,ap->end_time);
+  chTMAddMeasurementX(&ssp->stats.blocked,0,ap->blocked);
+  __ssHistAdd(ssp->stats.response_hist,ap->end_time-ap->enqueue_time);
+  __ssHistAdd(ssp->stats.exec_hist,ap->end_time-ap->start_time);
+}
+/*
+ * @brief   Starts the blocked time of a worker leaving the cpu inside a request
+ * @note    A preempted worker is ready and it is not blocked
+ */
+static void __ssBlockStart(ss_worker_t *wp){
+  if((wp->current!=NULL)&&(wp->thread->state!=CH_STATE_READY)){
+    wp->blocked=true;
+    wp->blocked_since=chSysGetRealtimeCounterX();
+  }
+}
+/*
+ * @brief   Adds the blocked time to the request of a worker entering the cpu
+ */
+static void __ssBlockEnd(ss_worker_t *wp){
+  if(wp->blocked){
+    wp->current->blocked+=chSysGetRealtimeCounterX()-wp->blocked_since;
+    wp->blocked=false;
+  }
+}
+#endif
+/*
+ * @brief   Removes the first request of the highest non-empty class
+ * @note    In EDF mode the earliest deadline is taken first, the requests without a deadline are served when the heap is empty
+ * @pre     the queue must not be empty
+ */
+static inline AperiodicRequest* __apQueueRemove(sporadic_server_t *ssp){
+  AperiodicRequest *ap;
+  uint32_t cls;
+#if SPORADIC_EDF == TRUE
+  if(ssp->edf_heap!=0){
+    ssp->requests_cnt--;
+    return __apHeapRemove(ssp);
+  }
+#endif
+  cls=__apClassTop(ssp);
+  ap=ssp->requests[cls];
+  ssp->requests[cls]=ap->next;
+  if(ssp->requests[cls]==0){
+    ssp->requests_tail[cls]=0;
+    ssp->class_map&=~((uint32_t)1U<<cls);
+  }
+  ssp->requests_cnt--;
+  return ap;
+}
+/*
+ * @brief   Unlinks a request that no worker has started from the FIFO queue of its class or from the deadline heap
+ * @note    O(length of the class queue), used only on the timeout of a waited request
+ * @pre     the request must be queued, it must not be in the ring
+ */
+static void __apQueueUnlink(sporadic_server_t *ssp,AperiodicRequest*ap){
+  AperiodicRequest **pp=&ssp->requests[ap->cls],*prev=0;
+  while((*pp!=0)&&(*pp!=ap)){
+    prev=*pp;
+    pp=&prev->next;
+  }
+  if(*pp==ap){
+    *pp=ap->next;
+    if(ssp->requests_tail[ap->cls]==ap)
+      ssp->requests_tail[ap->cls]=prev;
+    if(ssp->requests[ap->cls]==0)
+      ssp->class_map&=~((uint32_t)1U<<ap->cls);
+  }
+  else{
+#if SPORADIC_EDF == TRUE
+    __apHeapUnlink(ssp,ap);
+#else
+    chDbgAssert(false,"request not queued");
+#endif
+  }
+  ap->next=0;
+  ssp->requests_cnt--;
+}
+#if SPORADIC_COALESCE == TRUE
+/*
+ * @brief   Bucket of the pending unique requests for the function and the parameter of a request
+ * @note    The low bits of the pointers are dropped, they are the Thumb bit and the alignment
+ */
+static inline AperiodicRequest** __apUniqueBucket(sporadic_server_t *ssp,const AperiodicRequest*ap){
+  uintptr_t h=((uintptr_t)ap->fun_ptr>>1)^((uintptr_t)ap->arg>>2);
+  h^=h>>5;
+  return &ssp->unique[h&(SPORADIC_COALESCE_BUCKETS-1U)];
+}
+/*
+ * @brief   Checks a unique request against the pending ones
+ * @note    O(pending unique requests in the bucket), about 1/SPORADIC_COALESCE_BUCKETS of them unless the hash collides,
+ *          a request that is not a duplicate becomes pending
+ * @ret     true if an identical request is pending, the request must not be queued
+ */
+static bool __apCoalesce(sporadic_server_t *ssp,AperiodicRequest*ap){
+  AperiodicRequest *p,**bp;
+  if(!ap->unique)
+    return false;
+  bp=__apUniqueBucket(ssp,ap);
+  for(p=*bp;p!=0;p=p->unext){
+    if((p->fun_ptr==ap->fun_ptr)&&(p->arg==ap->arg)){
+      ssp->coalesced++;
+      return true;
+    }
+  }
+  ap->unext=*bp;
+  *bp=ap;
+  return false;
+}
+/*
+ * @brief   Unlinks the duplicates from a chain of requests
+ * @note    A duplicate gets MSG_RESET as result and goes back to the caller, the duplicates inside the chain are found too
+ * @post    first and last are updated, first is NULL if the whole chain has been coalesced
+ * @ret     number of requests unlinked
+ */
+static ucnt_t __apCoalesceChain(sporadic_server_t *ssp,AperiodicRequest**first,AperiodicRequest**last){
+  AperiodicRequest **pp=first,*ap,*prev=0;
+  ucnt_t dropped=0;
+  while((ap=*pp)!=0){
+    if(__apCoalesce(ssp,ap)){
+      *pp=ap->next;
+      ap->next=0;
+      ap->result=MSG_RESET;
+      dropped++;
+    }
+    else{
+      prev=ap;
+      pp=&ap->next;
+    }
+  }
+  *last=prev;
+  return dropped;
+}
+/*
+ * @brief   Removes a started request from the pending unique ones
+ */
+static void __apUniqueRemove(sporadic_server_t *ssp,AperiodicRequest*ap){
+  AperiodicRequest **pp=__apUniqueBucket(ssp,ap);
+  while(*pp!=0){
+    if(*pp==ap){
+      *pp=ap->unext;
+      ap->unext=0;
+      return;
+    }
+    pp=&(*pp)->unext;
+  }
+}
+#endif
+/*
+ * @brief   Inits the fields of a request shared by the user descriptors and the pooled ones
+ */
+static void __apInit(AperiodicRequest*ap,void*fun,void*arg){
+  ap->fun_ptr=(void (*)(void*))fun;
+  ap->arg=arg;
+  ap->next=0;
+  ap->result=MSG_OK;
+  ap->waiter=NULL;
+  ap->cls=0;
+  ap->state=SS_AP_IDLE;
+#if SPORADIC_EDF == TRUE
+  ap->timed=false;
+  ap->child=0;
+  ap->prev=0;
+#endif
+#if SPORADIC_COALESCE == TRUE
+  ap->unique=false;
+  ap->unext=0;
+#endif
+#if CH_CFG_USE_SEMAPHORES == TRUE
+  ap->sem=NULL;
+#endif
+#if CH_CFG_USE_EVENTS == TRUE
+  ap->esp=NULL;
+  ap->flags=(eventflags_t)0;
+#endif
+}
+/*
+ * @brief   Notifies the completion of a request to the objects attached to it
+ * @note    After this the request belongs again to the submitter and must not be touched
+ */
+static void __apComplete(AperiodicRequest*ap){
+  ap->state=SS_AP_DONE;
+#if CH_CFG_USE_SEMAPHORES == TRUE
+  if(ap->sem!=NULL)
+    chSemSignalI(ap->sem);
+#endif
+#if CH_CFG_USE_EVENTS == TRUE
+  if(ap->esp!=NULL)
+    chEvtBroadcastFlagsI(ap->esp,ap->flags);
+#endif
+  chThdResumeI(&ap->waiter,ap->result);
+}
+/*
+ * @brief   Moves the requests submitted from ISR in the FIFO queue
+ * @note    Called by a worker, the ring is drained in a single batch bounded by SPORADIC_RING_SIZE
+ * @ret     number of requests moved in the queue
+ */
+static ucnt_t __ssRingDrain(sporadic_server_t *ssp){
+  ucnt_t n=ssp->ring_cnt;
+  while(ssp->ring_cnt>0U){
+    __apQueueAppend(ssp,ssp->ring[ssp->ring_rd]);
+    if(++ssp->ring_rd>=SPORADIC_RING_SIZE)
+      ssp->ring_rd=0;
+    ssp->ring_cnt--;
+  }
+  return n;
+}
+/*
+ * @brief   Sporadic Server Thd, executed by every worker
+ * @par_in  pointer to the worker object
+ */
+static THD_FUNCTION(SporadicServer,args){
+  ss_worker_t *wp=(ss_worker_t*)args;
+  sporadic_server_t *ssp;
+  AperiodicRequest *ap;
+  ucnt_t n;
+  chSysLock();
+  ssp=wp->thread->ss;
+  while (true){
+    /* The ISR woke up a single worker, the other idle ones are woken up for the rest of the batch*/
+    n=__ssRingDrain(ssp);
+    if(n>1U)
+      __ssWakeIdle(ssp,n-1U);
+    /*suspends the worker if there are no more requests*/
+    if(ssp->requests_cnt==0U){
+#if SPORADIC_RECLAIM > 0
+      if((ssp->reclaim&SS_RECLAIM_DONATE)&&!__ssHasWork(ssp))
+        __ssDonate(ssp);
+#endif
+      chSchGoSleepS(CH_STATE_SLEEPING);
+      continue;
+    }
+    /*update the queue*/
+    ap=__apQueueRemove(ssp);
+#if SPORADIC_COALESCE == TRUE
+    /*a started request is no more a duplicate*/
+    if(ap->unique)
+      __apUniqueRemove(ssp,ap);
+#endif
+    ap->state=SS_AP_STARTED;
+    wp->current=ap;
+    ssp->busy++;
+#if SPORADIC_STATS == TRUE
+    ap->start_time=chSysGetRealtimeCounterX();
+    ap->consumed=__ssChargedNow(ssp);
+    ap->blocked=0;
+#endif
+    chSysUnlock();
+    /*executes the first function in the aperiodic quque*/
+    (*ap->fun_ptr)(ap->arg);
+    chSysLock();
+    wp->current=NULL;
+    ssp->busy--;
+    /*the continuation goes in the tail of its queue, the request is not completed*/
+    if(wp->requeue){
+      wp->requeue=false;
+      __apQueueAppend(ssp,ap);
+      chSchRescheduleS();
+      continue;
+    }
+#if SPORADIC_STATS == TRUE
+    __ssStatsUpdate(ssp,ap);
+#endif
+#if SPORADIC_EDF == TRUE
+    if(ap->timed&&__ssTimeBefore(ap->deadline,chVTGetSystemTimeX()))
+      ssp->deadline_misses++;
+#endif
+    __apComplete(ap);
+#if SPORADIC_POOL_SIZE > 0
+    if(ap->pooled)
+      chPoolFreeI(&ss_pool,ap);
+#endif
+    /*gives the cpu to an higher priority thread if any*/
+    chSchRescheduleS();
+  }
+}
+/*
+ * @brief   Attaches a thread to a server as a worker
+ * @post    the worker is linked in the list of the server
+ */
+static void __ssWorkerAttach(sporadic_server_t *ssp,ss_worker_t *wp,thread_t *td){
+  td->ss=ssp;
+  wp->thread=td;
+  wp->current=NULL;
+  wp->parked=false;
+  wp->requeue=false;
+#if SPORADIC_STATS == TRUE
+  wp->blocked=false;
+#endif
+  wp->next=ssp->workers;
+  ssp->workers=wp;
+}
+/*
+ * @brief   Creates a worker thread of the server, the thread waits for the first request
+ * @par_in  sporadic server object, worker object, working area and its size, priority
+ * @post    the worker is linked in the list of the server
+ */
+static thread_t* __ssWorkerInit(sporadic_server_t *ssp,ss_worker_t *wp,void *wsp,size_t size,tprio_t prio){
+  thread_t *td;
+  /* The thread structure is laid out in the upper part of the thread
+     workspace. The thread position structure is aligned to the required
+     stack alignment because it represents the stack top.*/
+  td = (thread_t *)((uint8_t *)wsp + size -
+                    MEM_ALIGN_NEXT(sizeof (thread_t), PORT_STACK_ALIGN));
+
+#if (CH_DBG_ENABLE_STACK_CHECK == TRUE) || (CH_CFG_USE_DYNAMIC == TRUE)
+  /* Stack boundary.*/
+  td->wabase = (stkalign_t *)wsp;
+#endif
+
+  PORT_SETUP_CONTEXT(td, wsp, td, SporadicServer, wp);
+
+  td = _thread_init(td, "sporadic", prio);
+  __ssWorkerAttach(ssp,wp,td);
+  return td;
+}
+/*
+ * @brief   inits the replinishment queue
+ * @post    the replinishment queue is empty
+ */
+static void __repArrInit(sporadic_server_t *ssp){
+  ssp->rep_head=0;
+  ssp->rep_cnt=0;
+  ssp->max_repl=NUM_REP;
+}
+/*
+ * @brief   Ring index of the n-th pending replinishment
+ */
+static inline uint32_t __repIdx(sporadic_server_t *ssp,uint32_t n){
+  n+=ssp->rep_head;
+  if(n>=NUM_REP)
+    n-=NUM_REP;
+  return n;
+}
+/*
+ * @brief   Finds the two pending replinishments with the closest release times
+ * @pre     there must be at least two replinishments
+ * @ret     position n of the pair (n,n+1), the gap is returned in gap
+ */
+static uint32_t __repArrClosest(sporadic_server_t *ssp,sysinterval_t *gap){
+  uint32_t best=0,n;
+  sysinterval_t d;
+  *gap=chTimeDiffX(ssp->rep_queue[__repIdx(ssp,0)].time,ssp->rep_queue[__repIdx(ssp,1)].time);
+  for(n=1;n+1U<ssp->rep_cnt;n++){
+    d=chTimeDiffX(ssp->rep_queue[__repIdx(ssp,n)].time,ssp->rep_queue[__repIdx(ssp,n+1U)].time);
+    if(d<*gap){
+      *gap=d;
+      best=n;
+    }
+  }
+  return best;
+}
+/*
+ * @brief   Merges the n-th replinishment in the next one
+ * @note    O(n), the earlier entries are moved one slot forward. Delaying a replinishment is always safe.
+ * @post    there is one less pending replinishment
+ */
+static void __repArrMerge(sporadic_server_t *ssp,uint32_t n){
+  ssp->rep_queue[__repIdx(ssp,n+1U)].amount+=ssp->rep_queue[__repIdx(ssp,n)].amount;
+  while(n>0U){
+    ssp->rep_queue[__repIdx(ssp,n)]=ssp->rep_queue[__repIdx(ssp,n-1U)];
+    n--;
+  }
+  if(++ssp->rep_head>=NUM_REP)
+    ssp->rep_head=0;
+  ssp->rep_cnt--;
+}
+/*
+ * @brief   inserts a replinishment in the tail of the replinishment queue
+ * @note    A replinishment close to the latest one is merged in it. When max_repl is reached the closest pair is merged,
+ *          the new replinishment takes part in the choice, so at most max_repl timer expirations are pending.
+ * @post    the replinishment is the last one to be released
+ */
+static void __repArrInsert(sporadic_server_t *ssp,systime_t time,ss_budget_t val){
+  uint32_t i,n;
+  sysinterval_t gap;
+  if(ssp->rep_cnt>0){
+    i=__repIdx(ssp,ssp->rep_cnt-1U);
+    if(chTimeDiffX(ssp->rep_queue[i].time,time)<=(sysinterval_t)SPORADIC_REP_MERGE){
+      ssp->rep_queue[i].time=time;
+      ssp->rep_queue[i].amount+=val;
+      return;
+    }
+    if(ssp->rep_cnt>=ssp->max_repl){
+      n=(ssp->rep_cnt>1U) ? __repArrClosest(ssp,&gap) : 0U;
+      /* The new replinishment is the closest one, the latest entry is delayed*/
+      if((ssp->rep_cnt==1U)||(chTimeDiffX(ssp->rep_queue[i].time,time)<=gap)){
+        ssp->rep_queue[i].time=time;
+        ssp->rep_queue[i].amount+=val;
+        return;
+      }
+      __repArrMerge(ssp,n);
+    }
+  }
+  i=__repIdx(ssp,ssp->rep_cnt);
+  ssp->rep_queue[i].time=time;
+  ssp->rep_queue[i].amount=val;
+  ssp->rep_cnt++;
+}
+/*
+ * @brief   Removes the earliest replinishment from the replinishment queue
+ * @note    O(1)
+ * @post    the head of the queue is now free
+ * @ret     0 if the queue is empty, else the capacity to be replinished
+ */
+static ss_budget_t __repArrRemove(sporadic_server_t *ssp){
+  ss_budget_t val;
+  if(ssp->rep_cnt==0)
+    return 0;
+  val=ssp->rep_queue[ssp->rep_head].amount;
+  if(++ssp->rep_head>=NUM_REP)
+    ssp->rep_head=0;
+  ssp->rep_cnt--;
+  return val;
+}
+/*
+ * @brief   Removes an amount of budget from the latest replinishments
+ * @note    Entries emptied by the trim are dropped, the earliest ones are the last to be touched
+ */
+static void __repArrTrim(sporadic_server_t *ssp,ss_budget_t excess){
+  uint32_t i;
+  while(excess>0 && ssp->rep_cnt>0){
+    i=__repIdx(ssp,ssp->rep_cnt-1U);
+    if(ssp->rep_queue[i].amount>excess){
+      ssp->rep_queue[i].amount-=excess;
+      return;
+    }
+    excess-=ssp->rep_queue[i].amount;
+    ssp->rep_cnt--;
+  }
+}
+/*
+ * @brief   Time left before the earliest replinishment
+ * @pre     there must be at least one replinishment
+ * @note    release times are never more than a period ahead, a bigger distance means that the release time is already passed
+ * @ret     0 if the earliest replinishment must be released now, else the delay before its release
+ */
+static sysinterval_t __repDelay(sporadic_server_t *ssp,systime_t now){
+  sysinterval_t d=chTimeDiffX(now,ssp->rep_queue[ssp->rep_head].time);
+  if(d>ssp->period)
+    return (sysinterval_t)0;
+  return d;
+}
+/*
+ * @brief   Programs the replinishment timer for the earliest replinishment
+ * @pre     the replinishment timer must not be armed
+ * @post    if there is a pending replinishment the timer is armed
+ */
+static void __repTimerArm(sporadic_server_t *ssp,systime_t now){
+  sysinterval_t d;
+  if(ssp->rep_cnt==0)
+    return;
+  d=__repDelay(ssp,now);
+  /* A due replinishment is released at the next tick*/
+  if(d==(sysinterval_t)0)
+    d=(sysinterval_t)1;
+  chVTDoSetI(&ssp->rep_vt,d,__SporadicServerReplinishmentCB,ssp);
+}
+#if SPORADIC_DBG
+static void __dbgArrInsert(sporadic_server_t *ssp,ss_budget_t val){
+  if(ssp->dbg_arr_index>=SPORADIC_DBG_SIZE)
+    ssp->dbg_arr_index=0;
+  ssp->dbg_arr[ssp->dbg_arr_index]=val;
+  ssp->dbg_arr_index++;
+}
+#endif
+/*
+ * @brief   Puts the server back in service after its capacity has been increased
+ * @par_in  sporadic server object, capacity before the increase
+ * @note    A server in background goes back to its priority, the workers parked on exhaustion go back in the ready list
+ *          and the idle ones are woken up only for the queued requests
+ */
+static void __ssCapacityRestored(sporadic_server_t *ssp,ss_budget_t old){
+  /* A server running in background goes back to its priority and its budget is charged again*/
+  if(ssp->background&&ssp->capacity>0){
+    ssp->background=false;
+    __ssChangePrio(ssp,ssp->prio);
+    if(__ssIsRunning(ssp)){
+      ssp->instance_start=SS_GET_STAMP();
+      ssp->policy->switch_in(ssp);
+    }
+    return;
+  }
+  /*an idle worker must be placed in the ready list only if there is a pending request,
+  * if not we will insert it in the ready list and when the first request will come CORRUPTION(of the rlist)
+  */
+  if(old==0&&ssp->capacity>0)
+    __ssResume(ssp);
+}
+/*
+ *@brief    CB of the server replinishment timer
+ *@par_in   pointer to the sporadic server object
+ *@post     the policy has updated the capacity and, if it was exhausted, the server is woken up if it has pending requests
+ */
+static void __SporadicServerReplinishmentCB(void*arg){
+  sporadic_server_t *ssp=(sporadic_server_t*)arg;
+  ss_budget_t old;
+
+  /* The callback runs outside the critical zone, the hooks use I-class APIs*/
+  chSysLockFromISR();
+  old=ssp->capacity;
+  ssp->policy->replenish(ssp);
+  /*
+   * Maybe unnecessary, but better be sure :)
+   */
+  if(ssp->capacity>ssp->maximum_capacity)
+    ssp->capacity=ssp->maximum_capacity;
+  __ssCapacityRestored(ssp,old);
+  chSysUnlockFromISR();
+}
+/*
+ * @brief   Arms the reservation timer unless it is already armed to expire earlier
+ * @par_in  sporadic server object, delay from now
+ */
+static void __ssReservationSet(sporadic_server_t *ssp,sysinterval_t delay){
+  systime_t now=chVTGetSystemTimeX();
+
+  if(chVTIsArmedI(&ssp->reservation_vt)){
+    if(chTimeDiffX(now,ssp->reservation_deadline)<=delay)
+      return;
+    chVTDoResetI(&ssp->reservation_vt);
+  }
+  ssp->reservation_deadline=chTimeAddX(now,delay);
+  chVTDoSetI(&ssp->reservation_vt,delay,__SporadicServerReservationCB,ssp);
+}
+/*
+ * @brief   Time reservation CallBack
+ * @par_in  pointer to the sporadic server object
+ * @note    The timer is lazy, it is not reset when the server is switched out so it may expire early or while
+ *          the server is not running. The budget left is checked here: if it is exhausted ending=true, after this
+ *          the IsPreemptionRequired function called going out from this VT will preempt the server, else the
+ *          timer is moved to the new exhaustion time.
+ * @note    A server with a background priority is charged and dropped here, before the preemption check at the ISR
+ *          exit, so the check compares the ready threads with the background priority. Dropped in the switch hook the
+ *          next thread would be already chosen, even one below the background priority.
+ */
+static void __SporadicServerReservationCB(void*arg){
+  sporadic_server_t *ssp=(sporadic_server_t*)arg;
+  ss_budget_t slice,left;
+  ss_stamp_t now;
+
+  chSysLockFromISR();
+  if(__ssIsRunning(ssp)&&!ssp->background){
+    slice=__ssSliceNow(ssp);
+    left=__ssBudgetLeft(ssp);
+    if(slice<left)
+      __ssReservationSet(ssp,SS_B2I(left-slice));
+    else if(ssp->low_prio!=NOPRIO){
+      now=SS_GET_STAMP();
+#if SPORADIC_IRQ_ACCOUNTING == TRUE
+      /* The ISR in progress is not charged, the epilogue does not charge a server in background*/
+      if(ss_irq_server==ssp){
+        ssp->isr_time+=SS_STAMP_DIFF(ss_irq_start,now);
+        ss_irq_server=NULL;
+      }
+#endif
+      __ssCharge(ssp,now);
+      ssp->instance_start=now;
+      if(__ssBudgetLeft(ssp)==0)
+        __ssBackground(ssp);
+      else
+        ssp->policy->switch_in(ssp);
+    }
+    else{
+      ssp->ending=true;
+#if SPORADIC_DBG
+      ssp->num_called++;
+#endif
+    }
+  }
+  chSysUnlockFromISR();
+}
+/*
+ * @brief   Switch in hook shared by the policies, arms the reservation timer
+ * @note    The remaining budget is rounded up to the next tick. A worker woken up by a semaphore or a mutex
+ *          while the capacity is exhausted is preempted at the next tick.
+ * @note    The timer is not reset at the switch out, a timer left armed by a previous slice is moved only if
+ *          the new exhaustion time is earlier, otherwise the callback re-arms it when it expires.
+ *          A preempted server costs no timer operation per switch.
+ */
+static void __ssArmReservation(sporadic_server_t *ssp){
+  ss_budget_t left=__ssBudgetLeft(ssp);
+  if(left>0)
+    __ssReservationSet(ssp,SS_B2I(left));
+  else if(!ssp->background)
+    __ssReservationSet(ssp,(sysinterval_t)1);
+}
+/*
+ * @brief   Exhaustion hook shared by the policies, removes the ready workers from the ready list
+ * @note    The workers that are sleeping or blocked inside a request are not touched, if they are woken up
+ *          before the replinishment they are preempted by the reservation timer.
+ * @post    the workers are parked until the policy gives back some capacity
+ */
+static void __ssSuspend(sporadic_server_t *ssp){
+  ss_worker_t *wp;
+  thread_t *tp;
+  for(wp=ssp->workers;wp!=NULL;wp=wp->next){
+    tp=wp->thread;
+    if(tp->state==CH_STATE_READY){
+      tp->queue.prev->queue.next=tp->queue.next;
+      tp->queue.next->queue.prev=tp->queue.prev;
+      tp->state=CH_STATE_SUSPENDED;
+      wp->parked=true;
+    }
+  }
+}
+/*
+ * @brief   Sporadic policy, replinishment hook
+ * @pre     there must be at least one replinishment
+ * @post    the due replinishments have been removed from the queue and the timer is armed for the next one
+ */
+static void __ssSporadicReplenish(sporadic_server_t *ssp){
+  systime_t now=chVTGetSystemTimeX();
+  /* Releasing all the replinishments that are due*/
+  while(ssp->rep_cnt>0 && __repDelay(ssp,now)==(sysinterval_t)0){
+#if SPORADIC_DBG
+    ss_budget_t rep=__repArrRemove(ssp);
+    __dbgArrInsert(ssp,rep);
+    ssp->capacity+=rep;
+#else
+    ssp->capacity+=__repArrRemove(ssp);
+#endif
+  }
+  /* Multiplexing the timer on the next replinishment*/
+  __repTimerArm(ssp,now);
+}
+/*
+ * @brief   Sporadic policy, switch out hook
+ * @note    The consumed time will be replinished a period after TA
+ */
+static void __ssSporadicSwitchOut(sporadic_server_t *ssp,ss_budget_t consumed){
+  ssp->timeToReplinish+=consumed;
+}
+/*
+ * @brief   Sporadic policy, context switch hook, manages TA and the replinishments
+ * @post    if Pexe<Psporadic ||Cs==0 a replinishment is posted
+ */
+static void __ssSporadicSchedule(sporadic_server_t *ssp,const thread_t*ntp,const thread_t*otp){
+  (void)otp;
+  if(ssp->capacity>0 && (ntp->prio)>=ssp->prio && ssp->mustUpdateTA){
+     ssp->TA=chVTGetSystemTimeX();
+     /*Guard variable*/
+     ssp->mustUpdateTA=false;
+     ss_active_cnt++;
+   }
+  else if((!((ntp->prio)>=ssp->prio)||ssp->capacity==0)&&(ssp->mustUpdateTA==false)){
+    ssp->mustUpdateTA=true;
+    ss_active_cnt--;
+    if(ssp->timeToReplinish!=0){
+      __repArrInsert(ssp,ssp->TA+ssp->period,ssp->timeToReplinish);
+      ssp->timeToReplinish=0;
+      /* If armed the timer is already programmed for an earlier replinishment*/
+      if(!chVTIsArmedI(&ssp->rep_vt))
+        __repTimerArm(ssp,chVTGetSystemTimeX());
+    }
+  }
+}
+/*
+ * @brief   Sporadic policy, reconfigure hook
+ * @note    The pending replinishments are moved to TA plus the new period, the shift is the same for all of them so the queue stays ordered.
+ *          The budget exceeding the new maximum capacity is removed from the latest replinishments.
+ */
+static void __ssSporadicReconfigure(sporadic_server_t *ssp,sysinterval_t old_period){
+  ss_budget_t pending=ssp->timeToReplinish,excess;
+  uint32_t i;
+  for(uint32_t n=0;n<ssp->rep_cnt;n++){
+    i=__repIdx(ssp,n);
+    ssp->rep_queue[i].time=(systime_t)(ssp->rep_queue[i].time-old_period+ssp->period);
+    pending+=ssp->rep_queue[i].amount;
+  }
+  if(ssp->capacity+pending>ssp->maximum_capacity){
+    excess=ssp->capacity+pending-ssp->maximum_capacity;
+    /* The budget not yet posted is the latest to be replinished*/
+    if(ssp->timeToReplinish>=excess){
+      ssp->timeToReplinish-=excess;
+      excess=0;
+    }
+    else{
+      excess-=ssp->timeToReplinish;
+      ssp->timeToReplinish=0;
+    }
+    __repArrTrim(ssp,excess);
+  }
+  if(chVTIsArmedI(&ssp->rep_vt))
+    chVTDoResetI(&ssp->rep_vt);
+  __repTimerArm(ssp,chVTGetSystemTimeX());
+}
+/*
+ * @brief   Periodic policies, init hook, starts the first period
+ */
+static void __ssPeriodicInit(sporadic_server_t *ssp){
+  ssp->TA=chVTGetSystemTimeX();
+  chVTDoSetI(&ssp->rep_vt,ssp->period,__SporadicServerReplinishmentCB,ssp);
+}
+/*
+ * @brief   Periodic policies, arms the timer at the end of the current period
+ * @note    An end already passed is handled at the next tick
+ */
+static void __ssPeriodicArm(sporadic_server_t *ssp){
+  sysinterval_t d=chTimeDiffX(chVTGetSystemTimeX(),ssp->TA+ssp->period);
+  if((d==(sysinterval_t)0)||(d>ssp->period))
+    d=(sysinterval_t)1;
+  chVTDoSetI(&ssp->rep_vt,d,__SporadicServerReplinishmentCB,ssp);
+}
+/*
+ * @brief   Periodic policies, starts the next period and re-arms the timer
+ * @note    The period start is advanced by a whole period so the release times do not drift
+ */
+static void __ssPeriodicNext(sporadic_server_t *ssp){
+  ssp->TA+=ssp->period;
+  __ssPeriodicArm(ssp);
+#if SPORADIC_DBG
+  __dbgArrInsert(ssp,ssp->maximum_capacity-ssp->capacity);
+#endif
+}
+/*
+ * @brief   Deferrable policy, replinishment hook, the full capacity is given back each period
+ */
+static void __ssDeferrableReplenish(sporadic_server_t *ssp){
+  __ssPeriodicNext(ssp);
+  ssp->capacity=ssp->maximum_capacity;
+}
+/*
+ * @brief   Polling policy, replinishment hook
+ * @note    The capacity is given back only if there are pending requests at the start of the period
+ */
+static void __ssPollingReplenish(sporadic_server_t *ssp){
+  __ssPeriodicNext(ssp);
+  ssp->capacity=__ssHasWork(ssp) ? ssp->maximum_capacity : (ss_budget_t)0;
+}
+/*
+ * @brief   Polling policy, switch out hook, the capacity left is lost when the queue becomes empty
+ */
+static void __ssPollingSwitchOut(sporadic_server_t *ssp,ss_budget_t consumed){
+  (void)consumed;
+  if(!__ssHasWork(ssp))
+    ssp->capacity=0;
+}
+/*
+ * @brief   Periodic policies, reconfigure hook, the current period ends a new period after its start
+ */
+static void __ssPeriodicReconfigure(sporadic_server_t *ssp,sysinterval_t old_period){
+  (void)old_period;
+  if(chVTIsArmedI(&ssp->rep_vt))
+    chVTDoResetI(&ssp->rep_vt);
+  __ssPeriodicArm(ssp);
+}
+/*
+ * @brief   Charges the running slice of the server
+ * @par_in  sporadic server object, end of the slice
+ * @post    the capacity and the policy have been updated, the slice is closed
+ */
+static void __ssCharge(sporadic_server_t *ssp,ss_stamp_t end){
+  /* The difference is modular, a wrap of the counter is handled*/
+  ss_budget_t slice=SS_STAMP_DIFF(ssp->instance_start,end);
+#if SPORADIC_IRQ_ACCOUNTING == TRUE
+  /* The ISRs that interrupted the slice are not charged*/
+  if(ssp->isr_time>slice)
+    ssp->isr_time=slice;
+  slice-=ssp->isr_time;
+#if SPORADIC_STATS == TRUE
+  ssp->stats.isr+=ssp->isr_time;
+#endif
+  ssp->isr_time=0;
+#endif
+#if SPORADIC_RECLAIM > 0
+  /* The spare capacity is consumed first, only the rest is charged to the server*/
+  if(ssp->reclaim&SS_RECLAIM_BORROW)
+    slice=__ssSpareTake(ssp,slice);
+#endif
+  ssp->consumed_time += slice;
+  /* Capacity update part */
+  if(ssp->consumed_time>=ssp->capacity)
+    ssp->capacity=0;
+  else
+    ssp->capacity=ssp->capacity -  ssp->consumed_time;
+  if(ssp->policy->switch_out!=NULL)
+    ssp->policy->switch_out(ssp,ssp->consumed_time);
+#if SPORADIC_STATS == TRUE
+  ssp->charged+=ssp->consumed_time;
+#endif
+  ssp->consumed_time=0;
+}
+/*
+ * @brief   Budget accounting of a single server
+ * @note    The common part calculates the consumed time and checks if the server is exhausted, the policy hooks do the rest.
+ * @post    in case we are the otp the capacity has been updated
+ */
+static void __ss_updatetime(sporadic_server_t *ssp,const thread_t*ntp,const thread_t*otp){
+  const ss_policy_t *pp=ssp->policy;
+#if SPORADIC_STATS == TRUE
+  /* The blocked time is measured before the exhaustion can park the worker*/
+  if(otp->ss==ssp)
+    __ssBlockStart(__ssWorkerOf(ssp,otp));
+  if(ntp->ss==ssp)
+    __ssBlockEnd(__ssWorkerOf(ssp,ntp));
+#endif
+  /* The workers share the budget, a switch between two workers closes a slice and opens the next one*/
+  if(otp->ss==ssp&&!ssp->background){
+    /*  if a worker of the server is leaving cpu, in background nothing is charged,
+     *  the reservation timer is left armed, see __ssArmReservation()*/
+    ssp->instance_end=SS_GET_STAMP();
+    __ssCharge(ssp,ssp->instance_end);
+    if(__ssBudgetLeft(ssp)==0){
+      /* POSIX sched_ss_low_priority, the server keeps running in slack time. Here the worker has been preempted by
+       * a higher priority thread or it is blocked, an exhaustion while running is handled by the reservation CB*/
+      if(ssp->low_prio!=NOPRIO)
+        __ssBackground(ssp);
+      else
+        pp->exhausted(ssp);
+    }
+  }
+  /*if a worker of the server is entering the cpu*/
+  if(ntp->ss==ssp){
+    ssp->instance_start=SS_GET_STAMP();
+#if SPORADIC_IRQ_ACCOUNTING == TRUE
+    ssp->isr_time=0;
+#endif
+    pp->switch_in(ssp);
+  }
+  if(pp->schedule!=NULL)
+    pp->schedule(ssp,ntp,otp);
+}
+
+/*
+ * @brief   Updates the priority below which the context switch hook takes the fast path
+ * @note    Only the servers with a schedule hook are considered, HIGHPRIO if there is none.
+ */
+static void __ssWatchUpdate(void){
+  sporadic_server_t *ssp;
+
+  ss_watch_prio=HIGHPRIO;
+  for(ssp=ss_list;ssp!=NULL;ssp=ssp->next){
+    if((ssp->policy->schedule!=NULL)&&(ssp->prio<ss_watch_prio))
+      ss_watch_prio=ssp->prio;
+  }
+}
+#if SPORADIC_RESERVATIONS > 0
+/*
+ * @brief   Removes a server from the list scanned by the context switch hook
+ */
+static void __ssListRemove(sporadic_server_t *ssp){
+  sporadic_server_t **pp=&ss_list;
+  while(*pp!=NULL){
+    if(*pp==ssp){
+      *pp=ssp->next;
+      return;
+    }
+    pp=&(*pp)->next;
+  }
+}
+#endif
+/*
+ * @brief   Inits the state of a server and adds it to the list scanned by the context switch hook
+ * @pre     the workers must have been attached, called with the kernel locked
+ */
+static void __ssObjectInit(sporadic_server_t *ssp,sysinterval_t period,sysinterval_t capacity,tprio_t priority,const ss_policy_t *policy){
+  ssp->policy=policy;
+  ssp->prio=priority;
+  ssp->low_prio=NOPRIO;
+  ssp->background=false;
+  ssp->period=period;
+  ssp->capacity=SS_I2B(capacity);
+  ssp->maximum_capacity=SS_I2B(capacity);
+  ssp->instance_start=0;
+  ssp->instance_end=0;
+  ssp->consumed_time=0;
+  ssp->TA=0;
+  for(uint32_t i=0;i<SPORADIC_CLASSES;i++){
+    ssp->requests[i]=0;
+    ssp->requests_tail[i]=0;
+  }
+  ssp->class_map=0;
+#if SPORADIC_COALESCE == TRUE
+  for(uint32_t i=0;i<SPORADIC_COALESCE_BUCKETS;i++)
+    ssp->unique[i]=0;
+  ssp->coalesced=0;
+#endif
+  ssp->requests_cnt=0;
+#if SPORADIC_EDF == TRUE
+  ssp->edf_heap=0;
+  ssp->edf=false;
+  ssp->deadline_misses=0;
+#endif
+  ssp->busy=0;
+  ssp->ring_rd=0;
+  ssp->ring_cnt=0;
+  ssp->ring_overflows=0;
+  ssp->ring_hwm=0;
+#if SPORADIC_STATS == TRUE
+  ssp->charged=0;
+  __ssStatsInit(&ssp->stats);
+#endif
+  ssp->mustUpdateTA=true;
+  ssp->timeToReplinish=0;
+  ssp->ending=false;
+#if SPORADIC_RECLAIM > 0
+  ssp->reclaim=0;
+#endif
+#if SPORADIC_IRQ_ACCOUNTING == TRUE
+  ssp->isr_time=0;
+#endif
+  __repArrInit(ssp);
+  chVTObjectInit(&ssp->rep_vt);
+  chVTObjectInit(&ssp->reservation_vt);
+  ssp->reservation_deadline=0;
+#if SPORADIC_DBG
+  for(uint8_t i=0;i<SPORADIC_DBG_SIZE;i++)
+    ssp->dbg_arr[i]=0;
+  ssp->dbg_arr_index=0;
+  ssp->num_called=0;
+#endif
+#if SPORADIC_INSERT_STATS == TRUE
+  for(uint32_t i=0;i<SPORADIC_INSERT_BINS;i++)
+    chTMObjectInit(&ssp->insert_tm[i]);
+  ssp->insert_max_depth=0;
+#endif
+  /* Adding the server to the list scanned by the context switch hook.*/
+  ssp->next=ss_list;
+  ss_list=ssp;
+  __ssWatchUpdate();
+  if(policy->init!=NULL)
+    policy->init(ssp);
+}
+/*
+ * @brief   Sporadic Server policy.
+ * @note    The consumed capacity is replinished a period after the start of the active interval.
+ */
+const ss_policy_t ss_policy_sporadic={
+  NULL,
+  __ssArmReservation,
+  __ssSporadicSwitchOut,
+  __ssSuspend,
+  __ssSporadicReplenish,
+  __ssSporadicSchedule,
+  __ssSporadicReconfigure
+};
+/*
+ * @brief   Deferrable Server policy.
+ * @note    The full capacity is given back at the start of each period and preserved while idle.
+ */
+const ss_policy_t ss_policy_deferrable={
+  __ssPeriodicInit,
+  __ssArmReservation,
+  NULL,
+  __ssSuspend,
+  __ssDeferrableReplenish,
+  NULL,
+  __ssPeriodicReconfigure
+};
+/*
+ * @brief   Polling Server policy.
+ * @note    The full capacity is given back at the start of each period if there are pending requests and it is lost when the queue becomes empty.
+ */
+const ss_policy_t ss_policy_polling={
+  __ssPeriodicInit,
+  __ssArmReservation,
+  __ssPollingSwitchOut,
+  __ssSuspend,
+  __ssPollingReplenish,
+  NULL,
+  __ssPeriodicReconfigure
+};
+
+/*===========================================================================*/
+/* Module exported functions.                                                */
+/*===========================================================================*/
+
+/*
+ * @brief   Sporadic servers module initialization
+ * @note    Called by chSysInit() before port_init() and chSysEnable(), nothing here may take the kernel lock
+ */
+void _ss_init(void){
+  ss_list=NULL;
+  ss_watch_prio=HIGHPRIO;
+  ss_active_cnt=0;
+#if SPORADIC_RECLAIM > 0
+  for(uint32_t i=0;i<SPORADIC_RECLAIM;i++)
+    ss_spare[i].donor=NULL;
+#endif
+#if SPORADIC_HOOK_STATS == TRUE
+  chTMObjectInit(&ss_hook_tm[0]);
+  chTMObjectInit(&ss_hook_tm[1]);
+#endif
+#if SPORADIC_RESERVATIONS > 0
+  for(uint32_t i=0;i<SPORADIC_RESERVATIONS;i++)
+    ss_res[i].thread=NULL;
+#endif
+#if SPORADIC_POOL_SIZE > 0
+  /* chPoolLoadArray() would lock and unlock the kernel, enabling the interrupts before port_init() and before currp
+   * is set. The descriptors are freed with the I-class API, the lock is only marked for the state checker.*/
+  chPoolObjectInit(&ss_pool,sizeof(AperiodicRequest),NULL);
+  _dbg_check_lock();
+  for(uint32_t i=0;i<SPORADIC_POOL_SIZE;i++)
+    chPoolFreeI(&ss_pool,&ss_pool_buf[i]);
+  _dbg_check_unlock();
+#endif
+}
+#if SPORADIC_IRQ_ACCOUNTING == TRUE
+/*
+ * @brief   IRQ prologue hook for the sporadic servers
+ * @note    The outermost ISR records the server that is charging its budget, if any
+ */
+void __sporadicserver_irq_prologue(void){
+  port_lock_from_isr();
+  if(ss_irq_nest++==0U){
+    ss_irq_server=((currp->ss!=NULL)&&!currp->ss->background) ? currp->ss : NULL;
+    ss_irq_start=SS_GET_STAMP();
+  }
+  port_unlock_from_isr();
+}
+/*
+ * @brief   IRQ epilogue hook for the sporadic servers
+ * @note    The duration of the outermost ISR, nested ones included, is subtracted from the running slice
+ */
+void __sporadicserver_irq_epilogue(void){
+  port_lock_from_isr();
+  if((--ss_irq_nest==0U)&&(ss_irq_server!=NULL)){
+    ss_irq_server->isr_time+=SS_STAMP_DIFF(ss_irq_start,SS_GET_STAMP());
+    ss_irq_server=NULL;
+  }
+  port_unlock_from_isr();
+}
+#endif
+/*
+ * @brief   Context Switch hook for the sporadic servers, slow path
+ * @note    Updates the budget of every initialized server, each server checks if it is the ntp or the otp.
+ */
+void __sporadicserver_updatetime_slow(const thread_t*ntp,const thread_t*otp){
+  sporadic_server_t *ssp=ss_list;
+  while(ssp!=NULL){
+    __ss_updatetime(ssp,ntp,otp);
+    ssp=ssp->next;
+  }
+}
+#if SPORADIC_HOOK_STATS == TRUE
+/*
+ * @brief   Closes the measurement of the context switch hook
+ * @par_in  slow path taken, realtime counter at the hook entry
+ */
+void __sporadicserver_hook_stats(bool slow,rtcnt_t start){
+  time_measurement_t *tmp=&ss_hook_tm[slow ? 1 : 0];
+
+  tmp->last=start;
+  chTMStopMeasurementX(tmp);
+}
+#endif
+/*
+ * @brief   Inits a sporadic server
+ * @par_in  sporadic server object, working area of the server thread and its size, period of the sporadic server,capacity of the sporadic server , priority of the sporadic server,
+ *          budget policy of the server (&ss_policy_sporadic, &ss_policy_deferrable or &ss_policy_polling)
+ * @pre     The sporadic server object must not be already initialized
+ * @post    The Sporadic Server Thd will be initialized, it will be woken up by the first request
+ * @note    With CH_CFG_USE_SS_ADMISSION the server is admitted as a task with C=capacity and T=D=period,
+ *          a deferrable server also has a jitter of period-capacity because of its back to back execution.
+ * @ret     Sporadic Server thd pointer, NULL if the server has not been admitted
+ */
+thread_t* chSporadicServerObjectInit(sporadic_server_t *ssp,void *wsp,size_t size,sysinterval_t period ,sysinterval_t capacity,tprio_t priority,const ss_policy_t *policy){
+  thread_t* td;
+
+  chDbgCheck((ssp != NULL) && (wsp != NULL) && (policy != NULL) &&
+             MEM_IS_ALIGNED(wsp, PORT_WORKING_AREA_ALIGN) &&
+             (size >= THD_WORKING_AREA_SIZE(0)) &&
+             MEM_IS_ALIGNED(size, PORT_STACK_ALIGN) &&
+             (priority <= HIGHPRIO) && (capacity > (sysinterval_t)0) &&
+             (capacity <= period));
+
+#if CH_CFG_USE_SS_ADMISSION == TRUE
+  chAdmTaskObjectInit(&ssp->adm,NULL,capacity,period,(sysinterval_t)0);
+  ssp->adm.prio=priority;
+  if(policy==&ss_policy_deferrable)
+    ssp->adm.jitter=period-capacity;
+  if(!chAdmTaskAdmit(&ssp->adm))
+    return NULL;
+#endif
+  chSysLock();
+  ssp->workers=NULL;
+  td=__ssWorkerInit(ssp,&ssp->worker,wsp,size,priority);
+  ssp->thread=td;
+  __ssObjectInit(ssp,period,capacity,priority,policy);
+  chSysUnlock();
+  return td;
+}
+
+/*
+ * @brief   Adds a worker thread to a server
+ * @note    The workers take the requests from the same queue and consume the same capacity, a request blocked on a
+ *          semaphore or a mutex does not stall the queue as long as another worker is idle.
+ * @par_in  sporadic server object, worker object, working area of the worker thread and its size
+ * @pre     the server must have been initialized
+ * @ret     the worker thread, it will be woken up by the first request
+ */
+thread_t* chSporadicServerAddWorker(sporadic_server_t *ssp,ss_worker_t *wp,void *wsp,size_t size){
+  thread_t *td;
+
+  chDbgCheck((ssp != NULL) && (wp != NULL) && (wsp != NULL) &&
+             MEM_IS_ALIGNED(wsp, PORT_WORKING_AREA_ALIGN) &&
+             (size >= THD_WORKING_AREA_SIZE(0)) &&
+             MEM_IS_ALIGNED(size, PORT_STACK_ALIGN));
+
+  chSysLock();
+  td=__ssWorkerInit(ssp,wp,wsp,size,ssp->background ? ssp->low_prio : ssp->prio);
+  /* Requests already waiting for a worker*/
+  if(__ssCanRun(ssp))
+    __ssWakeIdle(ssp,ssp->requests_cnt+ssp->ring_cnt);
+  chSchRescheduleS();
+  chSysUnlock();
+  return td;
+}
+
+#if SPORADIC_INSERT_STATS == TRUE
+/*
+ * @brief   Closes the measurement of an insertion in the log2 bucket of the resulting queue depth
+ * @par_in  sporadic server object, realtime counter at the insertion entry
+ */
+static void __ssInsertStats(sporadic_server_t *ssp,rtcnt_t start){
+  ucnt_t depth=ssp->requests_cnt;
+  uint32_t bin=0;
+  time_measurement_t *tmp;
+
+  while((depth>>=1)!=0U && bin<SPORADIC_INSERT_BINS-1)
+    bin++;
+  tmp=&ssp->insert_tm[bin];
+  tmp->last=start;
+  chTMStopMeasurementX(tmp);
+  if(ssp->requests_cnt>ssp->insert_max_depth)
+    ssp->insert_max_depth=ssp->requests_cnt;
+}
+#endif
+
+/*
+ *@brief    Inserts an aperiodic request in the aperiodic request queue and returns the pointer
+ *@note     It wakes up an idle worker if any, unless the server is waiting for a replinishment
+ *@note     O(1), the request is linked after the tail pointer
+ *@note     A unique request identical to a pending one is not queued, the caller still owns it
+ *@pre      the ap req should have been initialized previously
+ *@post     a new ap req in the queue of the sporadic
+ *@ret      pointer to the ap req, NULL if it has been coalesced
+ *@S class api
+ */
+AperiodicRequest* chSporadicServerAperiodicQueueInsertS(sporadic_server_t *ssp,AperiodicRequest*ap){
+  chDbgCheckClassS();
+  chDbgCheck((ssp != NULL) && (ap != NULL));
+#if SPORADIC_INSERT_STATS == TRUE
+  rtcnt_t start=chSysGetRealtimeCounterX();
+#endif
+#if SPORADIC_COALESCE == TRUE
+  if(__apCoalesce(ssp,ap)){
+#if SPORADIC_INSERT_STATS == TRUE
+    __ssInsertStats(ssp,start);
+#endif
+    return NULL;
+  }
+#endif
+
+#if SPORADIC_STATS == TRUE
+  ap->enqueue_time=chSysGetRealtimeCounterX();
+#endif
+  __apQueueAppend(ssp,ap);
+  /*
+   * Wakes up an idle worker, a server without capacity is woken up by the replinishment CB
+   */
+  if(__ssCanRun(ssp))
+    __ssWakeIdle(ssp,1);
+#if SPORADIC_INSERT_STATS == TRUE
+  __ssInsertStats(ssp,start);
+#endif
+  return ap;
+}
+
+/*
+ * @brief   Links a chain of requests in the queue and wakes up the idle workers for them
+ * @pre     the chain must be NULL terminated and contain n requests, n>0
+ */
+static void __apChainAppend(sporadic_server_t *ssp,AperiodicRequest*first,AperiodicRequest*last,ucnt_t n){
+#if SPORADIC_EDF == TRUE
+  /* In EDF mode each request goes in its queue, the splice is lost*/
+  if(ssp->edf){
+    AperiodicRequest *ap,*next;
+    for(ap=first;ap!=0;ap=next){
+      next=ap->next;
+      __apQueueAppend(ssp,ap);
+    }
+    if(__ssCanRun(ssp))
+      __ssWakeIdle(ssp,n);
+    return;
+  }
+#endif
+#if CH_DBG_ENABLE_ASSERTS == TRUE
+  for(AperiodicRequest *ap=first;ap!=0;ap=ap->next)
+    chDbgAssert(ap->cls==first->cls,"mixed classes");
+#endif
+  __apFifoSplice(ssp,first->cls,first,last);
+  ssp->requests_cnt+=n;
+  if(__ssCanRun(ssp))
+    __ssWakeIdle(ssp,n);
+}
+
+/*
+ *@brief    Splices an already linked chain of requests in the tail of the queue
+ *@note     O(1) in the number of requests, O(n) in EDF mode or with SPORADIC_COALESCE, at most n idle workers are woken up
+ *@pre      the chain must be NULL terminated and contain n requests
+ *@note     with SPORADIC_STATS the enqueue time of the requests is not set here, it must be set by the caller
+ *@note     the chain goes in the class of the first request, each unique request is checked as in
+ *          chSporadicServerAperiodicQueueInsertS(), a duplicate is unlinked from the chain and gets MSG_RESET as result
+ *@pre      all the requests must be of the same class, in EDF mode each request goes in the queue of its class
+ *@note     with SPORADIC_INSERT_STATS the whole chain is measured as one insertion
+ *@ret      number of requests coalesced, they still belong to the caller
+ *@S class api
+ */
+ucnt_t chSporadicServerSubmitChainS(sporadic_server_t *ssp,AperiodicRequest*first,AperiodicRequest*last,ucnt_t n){
+  ucnt_t dropped=0;
+  chDbgCheckClassS();
+  chDbgCheck((ssp != NULL) && (first != NULL) && (last != NULL) && (n > (ucnt_t)0));
+#if SPORADIC_INSERT_STATS == TRUE
+  rtcnt_t start=chSysGetRealtimeCounterX();
+#endif
+
+#if SPORADIC_COALESCE == TRUE
+  dropped=__apCoalesceChain(ssp,&first,&last);
+  n-=dropped;
+  if(n>(ucnt_t)0)
+#endif
+    __apChainAppend(ssp,first,last,n);
+#if SPORADIC_INSERT_STATS == TRUE
+  __ssInsertStats(ssp,start);
+#endif
+  return dropped;
+}
+
+/*
+ *@brief    Inserts a batch of aperiodic requests in the queue
+ *@note     The requests are linked outside the critical section in a chain per class, the kernel lock is taken once to
+ *          splice the chains and each idle worker is woken up at most once.
+ *@pre      the ap reqs should have been initialized previously and must not be queued
+ *@post     n more ap reqs in the queues of the sporadic, in the order of the array within each class, less the duplicates
+ *@ret      number of unique requests coalesced, each one has MSG_RESET as result and still belongs to the caller
+ */
+ucnt_t chSporadicServerSubmitBatch(sporadic_server_t *ssp,AperiodicRequest*const aps[],ucnt_t n){
+  AperiodicRequest *first[SPORADIC_CLASSES],*last[SPORADIC_CLASSES],*ap;
+  ucnt_t cnt[SPORADIC_CLASSES],dropped=0;
+  uint32_t cls;
+  chDbgCheck((ssp != NULL) && (aps != NULL));
 
-/*===========================================================================*/
-/* Module local variables.                                                   */
-/*===========================================================================*/
+  if(n==(ucnt_t)0)
+    return 0;
+  for(cls=0;cls<SPORADIC_CLASSES;cls++)
+    cnt[cls]=0;
+  for(ucnt_t i=0;i<n;i++){
+    ap=aps[i];
+    cls=ap->cls;
+#if SPORADIC_STATS == TRUE
+    ap->enqueue_time=chSysGetRealtimeCounterX();
+#endif
+    ap->next=0;
+    if(cnt[cls]==(ucnt_t)0)
+      first[cls]=ap;
+    else
+      last[cls]->next=ap;
+    last[cls]=ap;
+    cnt[cls]++;
+  }
+  chSysLock();
+  for(cls=0;cls<SPORADIC_CLASSES;cls++){
+    if(cnt[cls]>(ucnt_t)0)
+      dropped+=chSporadicServerSubmitChainS(ssp,first[cls],last[cls],cnt[cls]);
+  }
+  chSchRescheduleS();
+  chSysUnlock();
+  return dropped;
+}
 
 /*
- * @brief   Sporadic Server Reference
+ *@brief    Submits an aperiodic request from ISR context
+ *@note     The request is stored in the submission ring of the server, the server thread moves it in the FIFO queue.
+ *          The ISR does an O(1) enqueue and, if a worker is idle, a single wake up.
+ *@pre      the ap req should have been initialized previously
+ *@ret      MSG_OK if the request has been submitted, MSG_TIMEOUT if the ring is full (the overflow counter is updated),
+ *          MSG_RESET if a unique request identical to this one is pending, the caller still owns the request
+ *@note     A unique request is checked against the pending ones with the same hash, see SPORADIC_COALESCE_BUCKETS,
+ *          the ISR scans a single bucket
+ *@I class api
  */
-static thread_reference_t sporadic;
+msg_t chSporadicServerSubmitI(sporadic_server_t *ssp,AperiodicRequest*ap){
+  uint32_t i;
+  chDbgCheckClassI();
+  chDbgCheck((ssp != NULL) && (ap != NULL));
+
+  /* A duplicate is coalesced even if the ring is full, it would not take a slot*/
+#if SPORADIC_COALESCE == TRUE
+  if(__apCoalesce(ssp,ap))
+    return MSG_RESET;
+#endif
+  if(ssp->ring_cnt>=SPORADIC_RING_SIZE){
+#if SPORADIC_COALESCE == TRUE
+    if(ap->unique)
+      __apUniqueRemove(ssp,ap);
+#endif
+    ssp->ring_overflows++;
+    return MSG_TIMEOUT;
+  }
+#if SPORADIC_STATS == TRUE
+  ap->enqueue_time=chSysGetRealtimeCounterX();
+#endif
+  i=ssp->ring_rd+ssp->ring_cnt;
+  if(i>=SPORADIC_RING_SIZE)
+    i-=SPORADIC_RING_SIZE;
+  ssp->ring[i]=ap;
+  ssp->ring_cnt++;
+  if(ssp->ring_cnt>ssp->ring_hwm)
+    ssp->ring_hwm=ssp->ring_cnt;
+  /* A single idle worker is woken up, it drains the whole ring*/
+  if(__ssCanRun(ssp))
+    __ssWakeIdle(ssp,1);
+  return MSG_OK;
+}
+
+#if SPORADIC_POOL_SIZE > 0
 /*
- * @brief   array of capacity replinishments
+ *@brief    Takes a request descriptor from the kernel pool
+ *@note     O(1), the descriptor is initialized with no function, it goes back to the pool after its execution
+ *@ret      the descriptor or NULL if the pool is empty
+ *@I class api
  */
-static uint32_t replinishment_array[NUM_REP];
+AperiodicRequest* chSporadicServerAllocI(void){
+  AperiodicRequest *ap;
+  chDbgCheckClassI();
+
+  ap=(AperiodicRequest*)chPoolAllocI(&ss_pool);
+  if(ap!=NULL){
+    __apInit(ap,NULL,NULL);
+    ap->pooled=true;
+  }
+  return ap;
+}
+
 /*
- * @brief   Bitmap of the replinishment array
+ *@brief    Takes a request descriptor from the kernel pool
+ *@ret      the descriptor or NULL if the pool is empty
  */
-static uint32_t repArrBTM[NUM_REP];
+AperiodicRequest* chSporadicServerAlloc(void){
+  AperiodicRequest *ap;
+
+  chSysLock();
+  ap=chSporadicServerAllocI();
+  chSysUnlock();
+  return ap;
+}
+
 /*
- * @brief   Array of VT used to call the replinishment cb
+ *@brief    Gives back a descriptor that has not been submitted
+ *@note     A submitted descriptor is freed by the server, it must not be freed by the caller
+ *@I class api
  */
-static virtual_timer_t rep_vt[NUM_TIM];
+void chSporadicServerFreeI(AperiodicRequest*ap){
+  chDbgCheckClassI();
+  chDbgCheck((ap != NULL) && ap->pooled);
+
+  chPoolFreeI(&ss_pool,ap);
+}
+
 /*
- * @brief   Virtual timer that calls the reservation CB
+ *@brief    Submits a function from ISR context using a pooled descriptor
+ *@ret      MSG_OK if submitted, MSG_TIMEOUT if the pool is empty or the ring is full
+ *@I class api
  */
-static virtual_timer_t reservation_vt;
+msg_t chSporadicServerPostI(sporadic_server_t *ssp,void*fun,void*arg){
+  AperiodicRequest *ap;
+  chDbgCheckClassI();
+  chDbgCheck((ssp != NULL) && (fun != NULL));
+
+  ap=chSporadicServerAllocI();
+  if(ap==NULL)
+    return MSG_TIMEOUT;
+  ap->fun_ptr=(void (*)(void*))fun;
+  ap->arg=arg;
+  if(chSporadicServerSubmitI(ssp,ap)!=MSG_OK){
+    chPoolFreeI(&ss_pool,ap);
+    return MSG_TIMEOUT;
+  }
+  return MSG_OK;
+}
+
 /*
- * @brief   Sporadic Server Thd Working area
+ *@brief    Inserts a function in the queue of the server using a pooled descriptor
+ *@note     The caller does not own the descriptor, the same function can be posted again while it is still queued
+ *@ret      MSG_OK if queued, MSG_TIMEOUT if the pool is empty
  */
-static THD_WORKING_AREA(waSporadicServer,SPORADIC_WA);
-#if SPORADIC_DBG
-  static uint32_t dbg_arr[10]={1,1,1,1,1,1,1,1,1,1};
-  static uint8_t dbg_arr_index=0;
-  static uint32_t num_called=0;
+msg_t chSporadicServerPost(sporadic_server_t *ssp,void*fun,void*arg){
+  AperiodicRequest *ap;
+  chDbgCheck((ssp != NULL) && (fun != NULL));
+
+  chSysLock();
+  ap=chSporadicServerAllocI();
+  if(ap==NULL){
+    chSysUnlock();
+    return MSG_TIMEOUT;
+  }
+  ap->fun_ptr=(void (*)(void*))fun;
+  ap->arg=arg;
+  (void)chSporadicServerAperiodicQueueInsertS(ssp,ap);
+  chSchRescheduleS();
+  chSysUnlock();
+  return MSG_OK;
+}
 #endif
-/*===========================================================================*/
-/* Module local functions.                                                   */
-/*===========================================================================*/
+
 /*
- * @brief   Sporadic Server Thd
+ *@brief    Inserts an aperiodic request and waits for its completion
+ *@note     On timeout a request that no worker has started is removed from the queue, a started one is waited until its
+ *          completion, so the request can be released when the function returns
+ *@par_in   timeout, TIME_INFINITE waits forever
+ *@ret      the result set by the request with chSporadicServerSetResult(), MSG_OK by default, or MSG_TIMEOUT if the request
+ *          has not been started
  */
-static THD_FUNCTION(SporadicServer,args){
-  (void)args;
-  while (true){
-    /*executes the first function in the aperiodic quque*/
-    (void)(*sporadic->requests->fun_ptr)(sporadic->requests->arg);
-    /*update the queue*/
-    sporadic->requests=sporadic->requests->next;
-    /*suspends the sporadic server,must add a controll on thread priority , SchGoSleepS sets the new state, takes the next task from the ready list(setting it as current) and performs a context switch*/
-    if((sporadic->requests==0) || firstprio(&ch.rlist.queue)>sporadic->prio){
-      if(sporadic->requests==0)
-        chSchGoSleepS(CH_STATE_SLEEPING);
-      else if(firstprio(&ch.rlist.queue)>sporadic->prio){
-        chSchReadyI(sporadic);
-        chSchGoSleepS(CH_STATE_READY);
+msg_t chSporadicServerSubmitAndWait(sporadic_server_t *ssp,AperiodicRequest*ap,sysinterval_t timeout){
+  msg_t msg;
+
+  chSysLock();
+  ap->state=SS_AP_QUEUED;
+  if(chSporadicServerAperiodicQueueInsertS(ssp,ap)!=NULL){
+    msg=chThdSuspendTimeoutS(&ap->waiter,timeout);
+    if(msg==MSG_TIMEOUT){
+      if(ap->state==SS_AP_QUEUED){
+        __apQueueUnlink(ssp,ap);
+#if SPORADIC_COALESCE == TRUE
+        if(ap->unique)
+          __apUniqueRemove(ssp,ap);
+#endif
+        ap->state=SS_AP_IDLE;
       }
+      /*the completion does not find the waiter after the timeout*/
+      else if(ap->state==SS_AP_STARTED)
+        msg=chThdSuspendS(&ap->waiter);
+      else
+        msg=ap->result;
     }
   }
+  else{
+    ap->state=SS_AP_IDLE;
+    msg=MSG_RESET;
+  }
+  chSysUnlock();
+  return msg;
 }
+
 /*
- * @brief   find the index of the first free rp_vt
- * @pre     there must be a free vt, and the virtual timer array should contain less than 256 elements(in this case we won't know if it hasn't find the VT or it is the last)
- * @ret     returns the index of the free vt in the rep_vt array, if no free vt returns 255
+ *@brief    Sets the result of the running request
+ *@note     Must be called from the function of a request, the result is sent to the thread waiting in chSporadicServerSubmitAndWait()
  */
-static uint8_t  __get_freeVT(void){
-  for(uint8_t i=0;i<NUM_TIM;i++){
-    if(!chVTIsArmedI(&rep_vt[i]))
-      return i;
-  }
-  return 255;
+void chSporadicServerSetResult(msg_t msg){
+  ss_worker_t *wp;
+  chDbgAssert(currp->ss!=NULL,"not a worker");
+
+  wp=__ssWorkerOf(currp->ss,currp);
+  chDbgAssert((wp!=NULL)&&(wp->current!=NULL),"not a request");
+  wp->current->result=msg;
 }
 
 /*
- * @brief   inits the replinishment array and his bitmap
- * @pre     rep array shouldn't have been initialized
- * @post    rep array has been initialized and the bitman is composed from all 0(meaning all slots are free)
+ *@brief    Checks if the budget left covers the next chunk of the running request
+ *@note     Must be called from the function of a request or by a thread with a reservation. A long request calls it at its
+ *          safe points and, if there is not enough budget, it can queue its continuation with chSporadicServerRequeue()
+ *          and return, instead of being preempted in the middle of the chunk.
+ *@par_in   estimated duration of the next chunk
+ *@ret      true if the capacity left is not less than the chunk, false in background
  */
-static void __repArrInit(void){
-  for(uint32_t i=0;i<NUM_REP;i++){
-    replinishment_array[i]=0;
-    repArrBTM[i]=0;
+bool chSporadicServerCheckpoint(sysinterval_t chunk){
+  sporadic_server_t *ssp;
+  ss_budget_t slice,left;
+  bool ok=false;
+
+  chSysLock();
+  ssp=currp->ss;
+  chDbgAssert(ssp!=NULL,"not a worker");
+  if(!ssp->background){
+    slice=__ssSliceNow(ssp);
+    left=__ssBudgetLeft(ssp);
+    ok=(slice<left)&&(left-slice>=SS_I2B(chunk));
   }
+  chSysUnlock();
+  return ok;
 }
+
 /*
- * @brief   inserts a capacity in the replinishment array
- * @pre:    here should be a free slot to insert the replinishment, else it overwrites the last(bad solution)
- * @post    the next replinishment is inserted in the first available slot
+ *@brief    Queues again the running request with a new function and parameter
+ *@note     Must be called from the function of a request, the continuation is queued when the function returns, in the tail
+ *          of the queue of its class (or in the deadline heap in EDF mode), so the requests already queued run first.
+ *          The request is completed only when a function returns without calling this.
+ *@note     With SPORADIC_STATS the execution time of a split request is the one of its last chunk
  */
-static void __repArrInsert(uint32_t val){
-  bool cond=true;
-  uint32_t i=0;
-  /*find the first replinishment slot available*/
-  while(i<NUM_REP && cond){
-   if(repArrBTM[i]==0) {
-     replinishment_array[i]=val;
-     repArrBTM[i]=1;
-     cond=false;
-   }
-   else
-     i++;
-  }
-  /*if it didn't find an element,maybe there is a problem, overwrite the last*/
-  if(cond){
-    replinishment_array[NUM_REP-1]=val;
-    repArrBTM[NUM_REP-1]=1;
-  }
+void chSporadicServerRequeue(void*fun,void*arg){
+  ss_worker_t *wp;
+  chDbgCheck(fun != NULL);
+  chDbgAssert(currp->ss!=NULL,"not a worker");
+
+  wp=__ssWorkerOf(currp->ss,currp);
+  chDbgAssert((wp!=NULL)&&(wp->current!=NULL),"not a request");
+  wp->current->fun_ptr=(void (*)(void*))fun;
+  wp->current->arg=arg;
+  wp->requeue=true;
 }
+
 /*
- * @brief   Remove a capacity from the replinishment array
- * @pre     there should be at least one replinishment
- * @post    the first replinishment found is now free
- * @ret     0 if not found, else the capacity to be replinished
+ * @brief   Initializes an aperiodic request without queuing it
+ * @post    the request has no completion object attached, sem, esp/flags can be set afterwards
  */
-static uint32_t __repArrRemove(void){
-  for(uint32_t i=0;i<32;i++){
-    if(repArrBTM[i]==1){
-      repArrBTM[i]=0;
-      return replinishment_array[i];
-    }
-  }
-  return 0;
+void chSporadicServerAperiodicObjectInit(AperiodicRequest*ap,void*fun,void*arg){
+  chDbgCheck((ap != NULL) && (fun != NULL));
+
+  __apInit(ap,fun,arg);
+#if SPORADIC_POOL_SIZE > 0
+  ap->pooled=false;
+#endif
 }
-#if SPORADIC_DBG
-static void __dbgArrInsert(uint32_t val){
-  if(dbg_arr_index<10)
-     dbg_arr[dbg_arr_index]=val;
-  else{
-    dbg_arr_index=0;
-    dbg_arr[dbg_arr_index]=val;
-  }
-  dbg_arr_index++;
+
+/*
+ * @brief   Sets the service class of a request
+ * @note    A request of a class is served before all the requests of the lower classes, the default class is 0
+ * @pre     the request must have been initialized and must not be queued
+ */
+void chSporadicServerAperiodicSetClass(AperiodicRequest*ap,uint8_t cls){
+  chDbgCheck((ap != NULL) && (cls < SPORADIC_CLASSES));
+
+  ap->cls=cls;
 }
-#endif
+
+#if SPORADIC_COALESCE == TRUE
 /*
- *@brief    CB of the sporadic server replinishment
- *@pre      there must be at least one replinishment
- *@post     there is a new free slot in replinishment array and the capacity has been updated
+ * @brief   Marks a request as unique
+ * @note    A unique request is dropped at the submission if a unique request with the same function and parameter is
+ *          queued or in the ring and has not been started yet, the drop is counted in the coalesced counter
+ * @pre     the request must have been initialized and must not be queued
  */
-static void __SporadicServerReplinishmentCB(void*arg){
-  (void)arg;
-  uint32_t old=sporadic->capacity;
-#if SPORADIC_DBG
-  uint32_t rep=__repArrRemove();
-  __dbgArrInsert(rep);
-  sporadic->capacity+=rep;
-#elif
-  sporadic->capacity+=__repArrRemove();
-#endif
-  /*
-   * Maybe unnecessary, but better be sure :)
-   */
-  if(sporadic->capacity>sporadic->maximum_capacity)
-    sporadic->capacity=sporadic->maximum_capacity;
-  /*if the sporadic was suspended, means that his state was suspended and old capacity was 0
-  * Also we must place it in the ready list if it has a pending request, if not we will insert it in the ready list and when the
-  * first request will come CORRUPTION(of the rlist)
-  */
-  if(sporadic->state==CH_STATE_SUSPENDED&&old==0&&sporadic->requests!=0)
-    chSchReadyI(sporadic);
+void chSporadicServerAperiodicSetUnique(AperiodicRequest*ap,bool unique){
+  chDbgCheck(ap != NULL);
+
+  ap->unique=unique;
 }
 /*
- * @brief   Time reservation CallBack
- * @note    Set ending=true, after this the IsPreemptionRequired function called going out from this VT will set SS as Suspended and it will be preempted
+ * @brief   Returns the number of requests dropped because an identical one was pending
+ */
+ucnt_t chSporadicServerGetCoalesced(sporadic_server_t *ssp){
+  ucnt_t n;
+
+  chSysLock();
+  n=ssp->coalesced;
+  chSysUnlock();
+  return n;
+}
+#endif
+
+/*
+ * @brief   Initialize and insert an aperiodic request in the queue and returns his pointer
+ * @par_in  sporadic server object, function and its parameter, request object, service class
+ * @pre     the aperiodic request shouldn't have been initialized yet
+ * @post    there is one more aperiodic request in the queue of its class
+ * @ret     pointer to the aperiodic request
  */
-static void __SporadicServerReservationCB(void*args){
-  (void)args;
-  sporadic->ending=true;
-  num_called++;
+AperiodicRequest* chSporadicServerCreateAperiodic(sporadic_server_t *ssp,void*fun,void*arg,AperiodicRequest*ap,uint8_t cls){
+  chSporadicServerAperiodicObjectInit(ap,fun,arg);
+  chSporadicServerAperiodicSetClass(ap,cls);
+  chSysLock();
+  ap=chSporadicServerAperiodicQueueInsertS(ssp,ap);
+  chSchRescheduleS();
+  chSysUnlock();
+  return ap;
 }
 
-/*===========================================================================*/
-/* Module exported functions.                                                */
-/*===========================================================================*/
+/*
+ *@brief    Inserts an aperiodic request in the aperiodic request queue and returns the pointer
+ *@note     If it is the first request then it updates the sporadic
+ *@pre      the ap req should have been initialized previously
+ *@post     a new ap req in the queue of the sporadic
+ *@ret      pointer to the ap req, NULL if it has been coalesced
+ */
+AperiodicRequest*chSporadicServerAperiodicQueueInsert(sporadic_server_t *ssp,AperiodicRequest*ap){
+  chSysLock();
+  ap=chSporadicServerAperiodicQueueInsertS(ssp,ap);
+  chSchRescheduleS();
+  chSysUnlock();
+  return ap;
+}
 
 /*
- * @brief   Context Switch hook for the sporadic server
- * @note    The first part of the function (195-220) calculates the consumed time and checks if the Sporadic Exceed, the second (221-243) manages TA and the replinishments.
- * @pre     there must be a sporadic server active
- * @post    in case we are the otp the capacity has been updated, if Pexe<Psporadic ||Cs==0 a timer is armed
- */
-void __sporadicserver_updatetime(const thread_t*ntp,const thread_t*otp){
-  /*if the sporadic server is entering the cpu*/
-  if(ntp==sporadic){
-    sporadic->instance_start=chVTGetSystemTimeX();
-    chVTDoSetI(&reservation_vt,sporadic->capacity,__SporadicServerReservationCB,NULL);
-  }
-  else if(otp==sporadic){
-    /*  if the sporadic server is leaving cpu */
-    if(chVTIsArmed(&reservation_vt))
-      chVTDoResetI(&reservation_vt);
-    sporadic->instance_end=chVTGetSystemTimeX();
-    /*
-     * if we are in a new Clock cycle
-     */
-    if(sporadic->instance_start>sporadic->instance_end)
-      sporadic->consumed_time +=chTimeAddX(chTimeDiffX(sporadic->instance_start,TICK_BOUND),sporadic->instance_end);
-    else
-      sporadic->consumed_time += chTimeDiffX(sporadic->instance_start,sporadic->instance_end);
-    /* Capacity update part */
-    if(sporadic->consumed_time>=sporadic->capacity)
-      sporadic->capacity=0;
-    else
-      sporadic->capacity=sporadic->capacity -  sporadic->consumed_time;
-    /*updating to replinish */
-    sporadic->timeToReplinish +=sporadic->consumed_time;
-    sporadic->consumed_time=0;
+ * @brief   Changes period and capacity of the server
+ * @par_in  sporadic server object, new period, new capacity
+ * @note    The slice of a running server is charged with the old parameters. A bigger capacity is given at once,
+ *          a smaller one clamps the current capacity, the policy moves its pending replinishments and re-arms its timer.
+ * @note    The admission control is not run, see chSporadicServerSetParameters
+ * @post    a running server is re-armed with the new capacity, if it is left without budget it is preempted at the next tick
+ * @S class api
+ */
+void chSporadicServerSetParametersS(sporadic_server_t *ssp,sysinterval_t period,sysinterval_t capacity){
+  bool running;
+  sysinterval_t old_period;
+  ss_budget_t old,max;
+  ss_stamp_t now;
+
+  chDbgCheckClassS();
+  chDbgCheck((ssp != NULL) && (capacity > (sysinterval_t)0) && (capacity <= period));
+
+  running=__ssIsRunning(ssp)&&!ssp->background;
+  if(running){
+    if(chVTIsArmedI(&ssp->reservation_vt))
+      chVTDoResetI(&ssp->reservation_vt);
+    now=SS_GET_STAMP();
+    __ssCharge(ssp,now);
+    ssp->instance_start=now;
   }
-  if(sporadic->capacity>0 && (ntp->prio)>=sporadic->prio && sporadic->mustUpdateTA){
-     sporadic->TA=chVTGetSystemTimeX();
-     /*Guard variable*/
-     sporadic->mustUpdateTA=false;
-   }
-  else if((!((ntp->prio)>=sporadic->prio)||sporadic->capacity==0)&&(sporadic->mustUpdateTA==false)){
-    sporadic->mustUpdateTA=true;
-    /*Removing the sporadic from the ready list*/
-    if(sporadic->capacity==0 && otp==sporadic){
-      if(sporadic->state==CH_STATE_READY){
-        sporadic->queue.prev->queue.next=sporadic->queue.next;
-        sporadic->queue.next->queue.prev=sporadic->queue.prev;
-      }
-      sporadic->state=CH_STATE_SUSPENDED;
-    }
-    if(sporadic->timeToReplinish!=0){
-      __repArrInsert(sporadic->timeToReplinish);
-      sporadic->timeToReplinish=0;
-      chVTDoSetI(&rep_vt[ __get_freeVT()],(sporadic->TA+sporadic->period)-chVTGetSystemTimeX(),__SporadicServerReplinishmentCB,NULL);
+  old=ssp->capacity;
+  old_period=ssp->period;
+  max=SS_I2B(capacity);
+  if(max>ssp->maximum_capacity)
+    ssp->capacity+=max-ssp->maximum_capacity;
+  else if(ssp->capacity>max)
+    ssp->capacity=max;
+  ssp->period=period;
+  ssp->maximum_capacity=max;
+  if(ssp->policy->reconfigure!=NULL)
+    ssp->policy->reconfigure(ssp,old_period);
+  if(running)
+    __ssArmReservation(ssp);
+  __ssCapacityRestored(ssp,old);
+}
+
+/*
+ * @brief   Changes period and capacity of the server
+ * @note    With CH_CFG_USE_SS_ADMISSION the new parameters are admitted first
+ * @ret     false if the new parameters have not been admitted, the server is unchanged
+ */
+bool chSporadicServerSetParameters(sporadic_server_t *ssp,sysinterval_t period,sysinterval_t capacity){
+  chDbgCheck((ssp != NULL) && (capacity > (sysinterval_t)0) && (capacity <= period));
+
+#if CH_CFG_USE_SS_ADMISSION == TRUE
+  if(!chAdmTaskChange(&ssp->adm,capacity,period,(sysinterval_t)0,
+                      (ssp->policy==&ss_policy_deferrable) ? period-capacity : (sysinterval_t)0))
+    return false;
+#endif
+  chSysLock();
+  chSporadicServerSetParametersS(ssp,period,capacity);
+  chSchRescheduleS();
+  chSysUnlock();
+  return true;
+}
+
+/*
+ * @brief   Sets the background priority of the server
+ * @note    When the capacity is exhausted the server drops to this priority and keeps serving requests in slack time
+ *          without consuming budget, it goes back to its priority at the next replinishment (POSIX sched_ss_low_priority).
+ * @note    A server already in background moves at once to the new priority, with NOPRIO it is suspended as an
+ *          exhausted server, a running worker is preempted by the reservation timer at the next tick.
+ * @par_in  background priority, lower than the server priority, NOPRIO suspends the server on exhaustion (default)
+ */
+void chSporadicServerSetLowPriority(sporadic_server_t *ssp,tprio_t prio){
+  chDbgCheck((ssp != NULL) && (prio < ssp->prio));
 
+  chSysLock();
+  ssp->low_prio=prio;
+  if(ssp->background){
+    if(prio!=NOPRIO)
+      __ssChangePrio(ssp,prio);
+    else{
+      ssp->background=false;
+      __ssChangePrio(ssp,ssp->prio);
+      ssp->policy->exhausted(ssp);
+      if(__ssIsRunning(ssp)){
+        ssp->instance_start=SS_GET_STAMP();
+#if SPORADIC_IRQ_ACCOUNTING == TRUE
+        ssp->isr_time=0;
+#endif
+        ssp->policy->switch_in(ssp);
+      }
     }
+    chSchRescheduleS();
   }
+  chSysUnlock();
 }
+
 /*
- * @brief   Inits (the only one ) sporadic server
- * @par_in  period of the sporadic server,capacity of the sporadic server , priority of the sporadic server
- * @pre     This fun must be called only once
- * @post    The Sporadic Server Thd will be initialized
- * @ret     Sporadic Server thd pointer
+ * @brief   Sets the maximum number of pending replinishments of the server (POSIX sched_ss_max_repl)
+ * @note    A lower limit bounds the replinishment timer rate, the budget of the merged replinishments is given back later.
+ *          The pending replinishments over the new limit are merged at once.
+ * @par_in  limit in the range 1..NUM_REP
  */
-thread_t* chSporadicServerObjectInit(systime_t period ,systime_t capacity,tprio_t priority){
-  thread_t* td;
+void chSporadicServerSetMaxRepl(sporadic_server_t *ssp,uint8_t max_repl){
+  sysinterval_t gap;
+  chDbgCheck((ssp != NULL) && (max_repl > 0U) && (max_repl <= NUM_REP));
+
   chSysLock();
-  /* The thread structure is laid out in the upper part of the thread
-     workspace. The thread position structure is aligned to the required
-     stack alignment because it represents the stack top.*/
-  td = (thread_t *)((uint8_t *)waSporadicServer + sizeof(waSporadicServer) -
-                    MEM_ALIGN_NEXT(sizeof (thread_t), PORT_STACK_ALIGN));
+  ssp->max_repl=max_repl;
+  while(ssp->rep_cnt>max_repl)
+    __repArrMerge(ssp,__repArrClosest(ssp,&gap));
+  chSysUnlock();
+}
+#if SPORADIC_RECLAIM > 0
+/*
+ * @brief   Sets the bandwidth reclaiming mode of a server
+ * @note    With SS_RECLAIM_DONATE the capacity left when the last worker goes idle is put in the spare pool until the end
+ *          of the period, only a deferrable or a polling server can donate because its capacity is lost at the end of
+ *          the period anyway. A deferrable donor no more serves the requests arriving later in the same period with it.
+ * @note    With SS_RECLAIM_BORROW the server, or the thread of a reservation, consumes the spare capacity of the donors
+ *          with a priority not lower than its own before its capacity, a borrower exhausted when a capacity is donated
+ *          goes back in the ready list.
+ * @par_in  sporadic server object, mode, zero disables the reclaiming
+ */
+void chSporadicServerSetReclaim(sporadic_server_t *ssp,uint8_t mode){
+  chDbgCheck((ssp != NULL) && ((mode & ~(SS_RECLAIM_DONATE|SS_RECLAIM_BORROW)) == 0U));
+  chDbgAssert(((mode & SS_RECLAIM_DONATE) == 0U) || (ssp->policy != &ss_policy_sporadic),"sporadic policy can not donate");
 
-  PORT_SETUP_CONTEXT(td, waSporadicServer, td, SporadicServer, NULL);
-
-  td = _thread_init(td, "noname", priority);
-  td->period=period;
-  td->capacity=capacity;
-  td->maximum_capacity=capacity;
-  td->instance_start=0;
-  td->instance_end=0;
-  td->consumed_time=0;
-  td->TA=0;
-  td->requests=0;
-  td->mustUpdateTA=true;
-  td->timeToReplinish=0;
-  sporadic=td;
-  __repArrInit();
+  chSysLock();
+  ssp->reclaim=mode;
   chSysUnlock();
-  return td;
 }
+/*
+ * @brief   Returns the spare capacity that a server can borrow now
+ */
+ss_budget_t chSporadicServerGetSpare(sporadic_server_t *ssp){
+  ss_budget_t n;
+
+  chSysLock();
+  n=__ssSpareAvail(ssp);
+  chSysUnlock();
+  return n;
+}
+#endif
+#if SPORADIC_EDF == TRUE
+/*
+ * @brief   Sets the absolute deadline of a request
+ * @note    In EDF mode the request is served before the requests with a later deadline and before the ones without a deadline
+ * @pre     the request must have been initialized and must not be queued
+ */
+void chSporadicServerAperiodicSetDeadline(AperiodicRequest*ap,systime_t deadline){
+  chDbgCheck(ap != NULL);
 
+  ap->deadline=deadline;
+  ap->timed=true;
+}
 /*
- *@brief    Inserts an aperiodic request in the aperiodic request queue and returns the pointer
- *@note     If it is the first request then it updates the sporadic
- *@pre      the ap req should have been initialized previously
- *@post     a new ap req in the queue of the sporadic
- *@ret      pointer to the ap req
- *@S class api
+ * @brief   Enables or disables the deadline order of the request queue
+ * @note    When it is disabled the requests in the deadline heap are moved in the tail of the FIFO queue in deadline order,
+ *          when it is enabled the requests already in the FIFO queue keep their place.
  */
-AperiodicRequest* chSporadicServerAperiodicQueueInsertS(AperiodicRequest*ap){
-  /*
-   * If it is the first
-   */
-  if(sporadic->requests==0){
-    sporadic->requests=ap;
-    sporadic->requests->next=0;
-    chSchReadyI(sporadic);
-  }
-  /* else inserts it in the tail of the queue*/
-  else{
-    AperiodicRequest *app=sporadic->requests;
-    while(app->next!=0)
-      app=app->next;
-    app->next=ap;
-    ap->next=0;
+void chSporadicServerSetEDF(sporadic_server_t *ssp,bool edf){
+  chDbgCheck(ssp != NULL);
+
+  chSysLock();
+  ssp->edf=edf;
+  while(!edf&&(ssp->edf_heap!=0)){
+    ssp->requests_cnt--;
+    __apQueueAppend(ssp,__apHeapRemove(ssp));
   }
-  return ap;
+  chSysUnlock();
+}
+/*
+ * @brief   Returns the number of requests completed after their deadline
+ */
+ucnt_t chSporadicServerGetDeadlineMisses(sporadic_server_t *ssp){
+  ucnt_t n;
+
+  chSysLock();
+  n=ssp->deadline_misses;
+  chSysUnlock();
+  return n;
 }
+#endif
 
+#if SPORADIC_RESERVATIONS > 0
 /*
- * @brief   Initialize and insert an aperiodic request in the queue and returns his pointer
- * @pre     the aperiodic request shouldn't have been initialized yet
- * @post    there is one more aperiodic request in the aperiodic request queue
- * @ret     pointer to the aperiodic request
+ * @brief   Attaches a sporadic server budget to an ordinary thread
+ * @note    The thread is charged like a worker, it is preempted and parked when the budget is exhausted and it goes back
+ *          in the ready list at the replinishment. The server priority is the priority of the thread at this time.
+ * @note    The returned server accepts chSporadicServerSetParameters(), chSporadicServerSetLowPriority() and
+ *          chSporadicServerSetMaxRepl(), it must not be used to queue requests.
+ * @par_in  thread, budget and period of the reservation
+ * @pre     the reservation must be cleared before the thread terminates
+ * @ret     the reservation, NULL if there is no free reservation or it has not been admitted
  */
-AperiodicRequest* chSporadicServerCreateAperiodic(void*fun,void*arg,AperiodicRequest*ap){
+sporadic_server_t* chThdSetReservation(thread_t *tp,sysinterval_t budget,sysinterval_t period){
+  sporadic_server_t *ssp=NULL;
+  tprio_t prio;
+
+  chDbgCheck((tp != NULL) && (budget > (sysinterval_t)0) && (budget <= period));
+
   chSysLock();
-  ap->fun_ptr=fun;
-  ap->arg=arg;
-  ap=chSporadicServerAperiodicQueueInsertS(ap);
+  chDbgAssert(tp->ss==NULL,"already reserved");
+  for(uint32_t i=0;i<SPORADIC_RESERVATIONS;i++){
+    if(ss_res[i].thread==NULL){
+      ssp=&ss_res[i];
+      ssp->thread=tp;
+      break;
+    }
+  }
   chSysUnlock();
-  return ap;
+  if(ssp==NULL)
+    return NULL;
+#if CH_CFG_USE_SS_ADMISSION == TRUE
+  chAdmTaskObjectInit(&ssp->adm,tp,budget,period,(sysinterval_t)0);
+  if(!chAdmTaskAdmit(&ssp->adm)){
+    chSysLock();
+    ssp->thread=NULL;
+    chSysUnlock();
+    return NULL;
+  }
+#endif
+
+  chSysLock();
+#if CH_CFG_USE_MUTEXES == TRUE
+  prio=tp->realprio;
+#else
+  prio=tp->prio;
+#endif
+  ssp->workers=NULL;
+  __ssWorkerAttach(ssp,&ssp->worker,tp);
+  __ssObjectInit(ssp,period,budget,prio,&ss_policy_sporadic);
+  /* A running thread opens its slice now*/
+  if(tp==currp){
+    ssp->instance_start=SS_GET_STAMP();
+    ssp->policy->switch_in(ssp);
+  }
+  ssp->policy->schedule(ssp,currp,currp);
+  chSysUnlock();
+  return ssp;
 }
 
 /*
- *@brief    Inserts an aperiodic request in the aperiodic request queue and returns the pointer
- *@note     If it is the first request then it updates the sporadic
- *@pre      the ap req should have been initialized previously
- *@post     a new ap req in the queue of the sporadic
- *@ret      pointer to the ap req
+ * @brief   Removes the reservation of a thread
+ * @post    the thread is no more charged, if it was parked it goes back in the ready list at its priority
  */
-AperiodicRequest*chSporadicServerAperiodicQueueInsert(AperiodicRequest*ap){
+void chThdClearReservation(thread_t *tp){
+  sporadic_server_t *ssp;
+
+  chDbgCheck(tp != NULL);
+
   chSysLock();
-  ap=chSporadicServerAperiodicQueueInsertS(ap);
+  ssp=tp->ss;
+  chDbgAssert((ssp>=&ss_res[0])&&(ssp<&ss_res[SPORADIC_RESERVATIONS]),"not a reservation");
+  if(chVTIsArmedI(&ssp->rep_vt))
+    chVTDoResetI(&ssp->rep_vt);
+  if(chVTIsArmedI(&ssp->reservation_vt))
+    chVTDoResetI(&ssp->reservation_vt);
+  if(ssp->background){
+    ssp->background=false;
+    __ssChangePrio(ssp,ssp->prio);
+  }
+  if(!ssp->mustUpdateTA){
+    ssp->mustUpdateTA=true;
+    ss_active_cnt--;
+  }
+  __ssListRemove(ssp);
+  __ssWatchUpdate();
+  tp->ss=NULL;
+  ssp->ending=false;
+  if(ssp->worker.parked){
+    ssp->worker.parked=false;
+    chSchReadyI(tp);
+  }
+  chSchRescheduleS();
+  chSysUnlock();
+#if CH_CFG_USE_SS_ADMISSION == TRUE
+  chAdmTaskRemove(&ssp->adm);
+#endif
+  chSysLock();
+  ssp->thread=NULL;
   chSysUnlock();
-  return ap;
 }
+#endif
 
 /*
  * @brief   Used to check if the SS need to be woke up
  * @ret     True is the state is different fromm CH_STATE_READY
  */
-bool chSporadicServerNeedWU(void){
-  return sporadic->state!=CH_STATE_READY;
+bool chSporadicServerNeedWU(sporadic_server_t *ssp){
+  return ssp->thread->state!=CH_STATE_READY;
 }
 
 /*
  * @brief   Returns a pointer to the Sporadic Server thd
  * @ret     Sporadic Server Thread Pointer
  */
-thread_t* chSporadicServerGetInstance(void){
-  return sporadic;
+thread_t* chSporadicServerGetInstance(sporadic_server_t *ssp){
+  return ssp->thread;
+}
+/*
+ * @brief   Returns the counters of the ISR submission ring
+ * @out Number of requests rejected because the ring was full and maximum number of requests found in the ring
+ */
+void chSporadicServerGetRingStats(sporadic_server_t *ssp,ucnt_t*overflows,ucnt_t*hwm){
+  chSysLock();
+  *overflows=ssp->ring_overflows;
+  *hwm=ssp->ring_hwm;
+  chSysUnlock();
+}
+#if SPORADIC_HOOK_STATS == TRUE
+/*
+ * @brief   Returns the measurements of the context switch hook
+ * @out The fast path and the slow path durations, in realtime counter cycles
+ * @note    The fast path is the cost of the hook on a switch that does not involve the servers,
+ *          compared to a kernel without the hook it is the overhead paid by the other threads.
+ */
+void chSporadicServerGetHookStats(time_measurement_t*fast,time_measurement_t*slow){
+  chSysLock();
+  *fast=ss_hook_tm[0];
+  *slow=ss_hook_tm[1];
+  chSysUnlock();
+}
+/*
+ * @brief   Clears the measurements of the context switch hook
+ */
+void chSporadicServerResetHookStats(void){
+  chSysLock();
+  chTMObjectInit(&ss_hook_tm[0]);
+  chTMObjectInit(&ss_hook_tm[1]);
+  chSysUnlock();
+}
+#endif
+#if SPORADIC_STATS == TRUE
+/*
+ * @brief   Returns a copy of the requests timing statistics
+ * @out The aggregate statistics, in realtime counter cycles
+ */
+void chSporadicServerGetStats(sporadic_server_t *ssp,ss_stats_t*sp){
+  chSysLock();
+  *sp=ssp->stats;
+  chSysUnlock();
+}
+/*
+ * @brief   Clears the requests timing statistics
+ */
+void chSporadicServerResetStats(sporadic_server_t *ssp){
+  chSysLock();
+  __ssStatsInit(&ssp->stats);
+  chSysUnlock();
 }
+#endif
 #if SPORADIC_DBG
 
 /*
- * @brief   Obtain a vector of last timeConsumed
- * @out Number of element in the array and the array
+ * @brief   Obtain a vector of last replinishments, in system ticks
+ * @out Number of element in the array, the array and the number of reservation CB calls
  *
  */
-void chSporadicServerGetTime(uint32_t*num,uint32_t*arr,uint32_t* called_time){
-  *num=dbg_arr_index;
+void chSporadicServerGetTime(sporadic_server_t *ssp,uint8_t*num,uint32_t*arr,uint32_t* called_time){
+  chSysLock();
+  *num=ssp->dbg_arr_index;
   for(uint8_t i=0;i<*num;i++)
-    arr[i]=dbg_arr[i];
-  *called_time=num_called;
+    arr[i]=(uint32_t)SS_B2I(ssp->dbg_arr[i]);
+  *called_time=ssp->num_called;
+  chSysUnlock();
+}
+#endif
+#if SPORADIC_INSERT_STATS == TRUE
+
+/*
+ * @brief   Obtain the measurements of the queue insertion critical section
+ * @out The insertion time measurements (in realtime counter cycles), an array of SPORADIC_INSERT_BINS elements where
+ *      the element i is for the queue depths in [2^i,2^(i+1)), and the maximum queue depth seen by an insertion
+ * @note    The duplicate check of the unique requests is included and the coalesced insertions are counted too,
+ *          a chain submitted with chSporadicServerSubmitChainS() or chSporadicServerSubmitBatch() counts as one insertion
+ *
+ */
+void chSporadicServerGetInsertStats(sporadic_server_t *ssp,time_measurement_t*tmp,ucnt_t*max_depth){
+  chSysLock();
+  for(uint32_t i=0;i<SPORADIC_INSERT_BINS;i++)
+    tmp[i]=ssp->insert_tm[i];
+  *max_depth=ssp->insert_max_depth;
+  chSysUnlock();
 }
 #endif
 #endif/*CH_CFG_USE_SS*/
@@ -122,6 +122,9 @@ void chSysInit(void) {
 #if CH_DBG_STATISTICS == TRUE
   _stats_init();
 #endif
+#if CH_CFG_USE_SS == TRUE
+  _ss_init();
+#endif
 
 #if CH_CFG_NO_IDLE_THREAD == FALSE
   /* Now this instructions flow becomes the main thread.*/
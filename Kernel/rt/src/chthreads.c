@@ -118,6 +118,9 @@ thread_t *_thread_init(thread_t *tp, const char *name, tprio_t prio) {
 #endif
 #if CH_DBG_STATISTICS == TRUE
   chTMObjectInit(&tp->stats);
+#endif
+#if CH_CFG_USE_SS == TRUE
+  tp->ss        = NULL;
 #endif
   CH_CFG_THREAD_INIT_HOOK(tp);
   return tp;
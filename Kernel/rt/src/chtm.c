@@ -151,6 +151,26 @@ NOINLINE void chTMChainMeasurementToX(time_measurement_t *tmp1,
   tm_stop(tmp1, tmp2->last, (rtcnt_t)0);
 }
 
+/**
+ * @brief   Accumulates a measurement taken elsewhere.
+ * @details The interval between two realtime counter values is accumulated
+ *          in the object, this allows to measure intervals that start and
+ *          stop in different contexts.
+ * @pre     The @p time_measurement_t structure must be initialized.
+ *
+ * @param[in,out] tmp   pointer to a @p time_measurement_t structure
+ * @param[in] start     realtime counter value at the start of the interval
+ * @param[in] end       realtime counter value at the end of the interval
+ *
+ * @xclass
+ */
+void chTMAddMeasurementX(time_measurement_t *tmp,
+                         rtcnt_t start, rtcnt_t end) {
+
+  tmp->last = start;
+  tm_stop(tmp, end, (rtcnt_t)0);
+}
+
 #endif /* CH_CFG_USE_TM == TRUE */
 
 /** @} */
@@ -399,12 +399,71 @@
  * @details If enabled then the Sporadic Server APIs are included
  *          in the kernel.
  *
- * @note    This will also cause the AperiodicRequest declaration in chschd.h, Sporadic Server
- *          fields added to ch_thread and an additional check in the IsPreemptionRequired fun
+ * @note    This will also cause the AperiodicRequest declaration in chschd.h, the owning
+ *          sporadic server pointer added to ch_thread and an additional check in the IsPreemptionRequired fun
  */
 #if !defined(CH_CFG_USE_SS)
 #define CH_CFG_USE_SS                       TRUE
 #endif
+
+/**
+ * @brief   Sporadic servers admission control.
+ * @details If enabled the servers, and the periodic threads registered
+ *          with @p chAdmTaskAdmit(), are admitted only if the set stays
+ *          schedulable.
+ *
+ * @note    Requires @p CH_CFG_USE_SS and @p CH_CFG_USE_MUTEXES.
+ */
+#if !defined(CH_CFG_USE_SS_ADMISSION)
+#define CH_CFG_USE_SS_ADMISSION             FALSE
+#endif
+
+/**
+ * @brief   Sporadic servers request pool.
+ * @details Number of request descriptors managed by the kernel, the
+ *          descriptors are returned to the pool after their execution.
+ *          Zero disables the pool.
+ *
+ * @note    Requires @p CH_CFG_USE_MEMPOOLS.
+ */
+#if !defined(SPORADIC_POOL_SIZE)
+#define SPORADIC_POOL_SIZE                  8
+#endif
+
+/**
+ * @brief   Sporadic servers context switch hook measurement.
+ * @details If enabled the duration of the context switch hook is measured,
+ *          the fast path is the overhead of the hook on the switches that
+ *          do not involve the servers. It adds two counter reads and a
+ *          measurement update to every context switch, enable it only
+ *          when measuring.
+ *
+ * @note    Requires @p CH_CFG_USE_TM.
+ */
+#if !defined(SPORADIC_HOOK_STATS)
+#define SPORADIC_HOOK_STATS                 FALSE
+#endif
+
+/**
+ * @brief   Sporadic servers queue insertion measurement.
+ * @details If enabled the insertion critical section is measured in
+ *          log2 buckets of the queue depth, it adds a realtime counter
+ *          read and a measurement update to every insertion.
+ *
+ * @note    Requires @p CH_CFG_USE_TM.
+ */
+#if !defined(SPORADIC_INSERT_STATS)
+#define SPORADIC_INSERT_STATS               FALSE
+#endif
+
+/**
+ * @brief   Sporadic servers duplicate requests coalescing.
+ * @details If enabled a request marked as unique is dropped while an
+ *          identical request is pending and not started yet.
+ */
+#if !defined(SPORADIC_COALESCE)
+#define SPORADIC_COALESCE                   TRUE
+#endif
 /** @} */
 
 /*===========================================================================*/
@@ -651,6 +710,7 @@
  */
 #define CH_CFG_IRQ_PROLOGUE_HOOK() {                                        \
   /* IRQ prologue code here.*/                                              \
+  __sporadicserver_irq_prologue();                                          \
 }
 
 /**
@@ -658,6 +718,7 @@
  */
 #define CH_CFG_IRQ_EPILOGUE_HOOK() {                                        \
   /* IRQ epilogue code here.*/                                              \
+  __sporadicserver_irq_epilogue();                                          \
 }
 
 /**
@@ -19,6 +19,8 @@ void BW(void* );
 static SerialConfig my_serial;
 static BaseSequentialStream* bsp;
 static thread_reference_t t;
+static sporadic_server_t ss;
+static THD_WORKING_AREA(waSporadicServer, SPORADIC_WA);
 static uint32_t exec=0;
 static THD_WORKING_AREA(waThread1, 128);
 static THD_FUNCTION(Thread1, arg) {
@@ -28,11 +30,33 @@ static THD_FUNCTION(Thread1, arg) {
   uint32_t consumed_arr[10]={0,0,0};
   uint8_t num_element;
   uint32_t num=0;
+#if SPORADIC_INSERT_STATS == TRUE
+  time_measurement_t insert_tm[SPORADIC_INSERT_BINS];
+  ucnt_t max_depth;
+#endif
+#if SPORADIC_HOOK_STATS == TRUE
+  time_measurement_t fast_tm,slow_tm;
+#endif
   while (true) {
-    chSporadicServerGetTime(&num_element,consumed_arr,&num);
+    chSporadicServerGetTime(&ss,&num_element,consumed_arr,&num);
     chprintf(bsp,"Elements in the array %u \n\r",num_element);
     chprintf(bsp,"Reservation called %u \n\r",num);
     chprintf(bsp,"Aperiodic Req executed %lu \n \r",exec);
+#if SPORADIC_INSERT_STATS == TRUE
+    chSporadicServerGetInsertStats(&ss,insert_tm,&max_depth);
+    chprintf(bsp,"Max queue depth %lu, insert cycles per depth :\n\r",max_depth);
+    for(uint8_t i=0;i<SPORADIC_INSERT_BINS;i++)
+      if(insert_tm[i].n!=0U)
+        chprintf(bsp,"  depth %lu+ best %lu worst %lu (n %lu) \n\r",1UL<<i,insert_tm[i].best,insert_tm[i].worst,insert_tm[i].n);
+#endif
+#if SPORADIC_COALESCE == TRUE
+    chprintf(bsp,"Coalesced requests %lu \n\r",chSporadicServerGetCoalesced(&ss));
+#endif
+#if SPORADIC_HOOK_STATS == TRUE
+    chSporadicServerGetHookStats(&fast_tm,&slow_tm);
+    chprintf(bsp,"Switch hook cycles fast %lu/%lu (n %lu), slow %lu/%lu (n %lu) \n\r",
+             fast_tm.best,fast_tm.worst,fast_tm.n,slow_tm.best,slow_tm.worst,slow_tm.n);
+#endif
     chprintf(bsp,"Consumed times :\n \r");
     for(uint8_t i=0;i<num_element;i++)
       chprintf(bsp,"%lu \n\r",TIME_I2MS(consumed_arr[i]));
@@ -40,6 +64,45 @@ static THD_FUNCTION(Thread1, arg) {
     chThdSleepMilliseconds(10);
   }
 }
+/*
+ * Returned by PostRequest() when the kernel pool is empty
+ */
+#define POST_NO_DESCRIPTOR ((msg_t)-3)
+/*
+ * Posts a unique request, MSG_RESET if an identical one is still pending.
+ * With the kernel pool the descriptor is taken from it, MSG_TIMEOUT if the ring is full and POST_NO_DESCRIPTOR if the pool is empty,
+ * without the pool the descriptor is on the stack and the request is waited
+ */
+static msg_t PostRequest(void*fun,void*arg){
+#if SPORADIC_POOL_SIZE > 0
+  AperiodicRequest *ap;
+  msg_t msg;
+  chSysLock();
+  ap=chSporadicServerAllocI();
+  if(ap==NULL){
+    chSysUnlock();
+    return POST_NO_DESCRIPTOR;
+  }
+  ap->fun_ptr=(void (*)(void*))fun;
+  ap->arg=arg;
+#if SPORADIC_COALESCE == TRUE
+  chSporadicServerAperiodicSetUnique(ap,true);
+#endif
+  msg=chSporadicServerSubmitI(&ss,ap);
+  if(msg!=MSG_OK)
+    chSporadicServerFreeI(ap);
+  chSchRescheduleS();
+  chSysUnlock();
+  return msg;
+#else
+  AperiodicRequest ap;
+  chSporadicServerAperiodicObjectInit(&ap,fun,arg);
+#if SPORADIC_COALESCE == TRUE
+  chSporadicServerAperiodicSetUnique(&ap,true);
+#endif
+  return chSporadicServerSubmitAndWait(&ss,&ap,TIME_INFINITE);
+#endif
+}
 int main(void){
   halInit();
   chSysInit();
@@ -49,28 +112,29 @@ int main(void){
   my_serial.cr3=0;
   sdStart(&SD2, &my_serial);
   bsp=(BaseSequentialStream*)&SD2;
-  t=chSporadicServerObjectInit(TIME_MS2I(1000),TIME_MS2I(500),NORMALPRIO+2);
-  AperiodicRequest k,k1,k2;
+  t=chSporadicServerObjectInit(&ss,waSporadicServer,sizeof(waSporadicServer),TIME_MS2I(1000),TIME_MS2I(500),NORMALPRIO+2,&ss_policy_sporadic);
   bool first=true;
   uint16_t time_towt=(100);
   /*
-   * If it is the first initialization creates the sporadic server requests, then inserts requests in the queue again if the sporadic server when the button is pressed
+   * If it is the first initialization creates the observer, then posts three requests when the button is pressed, the descriptors are taken from the kernel pool.
+   * The requests are unique, while one is pending the others are coalesced
    */
   while(true){
     if(first){
-      chSporadicServerCreateAperiodic(BW,(void*)&time_towt,&k);
       chThdCreateStatic(waThread1, sizeof(waThread1), NORMALPRIO+1, Thread1, NULL);
-      chSporadicServerCreateAperiodic(BW,(void*)&time_towt,&k1);
-      chSporadicServerCreateAperiodic(BW,(void*)&time_towt,&k2);
       first=false;
     }
    //chprintf(bsp,"Sporadic time %lu, sporadic capacity %lu, sporadic last TA %lu ,sporadic time to replinish %lu, and exec %lu \n \r",TIME_I2MS(t->consumed_time),TIME_I2MS(t->capacity),TIME_I2MS(t->TA),TIME_I2MS(t->timeToReplinish),exec);
    // chprintf(bsp,"Last rep %lu \n\r ",TIME_I2MS(chSporadicServerGetLastReplinishment()));
     if (!palReadPad(GPIOC, GPIOC_BUTTON)) {
           chprintf(bsp,"Button pressed \n \r");
-          chSporadicServerAperiodicQueueInsert(&k);
-          chSporadicServerAperiodicQueueInsert(&k1);
-          chSporadicServerAperiodicQueueInsert(&k2);
+          for(uint8_t i=0;i<3;i++){
+            msg_t msg=PostRequest(BW,(void*)&time_towt);
+            if(msg==POST_NO_DESCRIPTOR)
+              chprintf(bsp,"Request pool empty \n\r");
+            else if(msg==MSG_TIMEOUT)
+              chprintf(bsp,"Submission ring full \n\r");
+          }
     }
     chThdSleepMilliseconds(100);
   }
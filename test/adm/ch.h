@@ -0,0 +1,56 @@
+/*
+    This file is not part of the original ChibiOs 191.
+    Copyright (C) 2021 Antonio Emmanuele.
+*/
+/**
+ * @file    test/adm/ch.h
+ * @brief   Host stub of the kernel header for the admission control test.
+ * @note    It replaces the kernel header when chadm.c is built on the host, the
+ *          mutex is a counter checked by the test.
+ */
+#ifndef CH_H
+#define CH_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <assert.h>
+
+#define FALSE                       0
+#define TRUE                        1
+
+#define CH_CFG_USE_SS               TRUE
+#define CH_CFG_USE_MUTEXES          TRUE
+#define CH_CFG_USE_SS_ADMISSION     TRUE
+
+#define NORMALPRIO                  128U
+
+typedef uint32_t sysinterval_t;
+typedef uint32_t tprio_t;
+
+typedef struct {
+  tprio_t realprio;
+} thread_t;
+
+typedef struct {
+  int cnt;
+} mutex_t;
+
+#define MUTEX_DECL(name)            mutex_t name = {0}
+
+#define chDbgCheck(c)               assert(c)
+#define chDbgAssert(c, r)           assert(c)
+
+static inline void chMtxLock(mutex_t *mp) {
+  assert(mp->cnt == 0);
+  mp->cnt++;
+}
+
+static inline void chMtxUnlock(mutex_t *mp) {
+  assert(mp->cnt == 1);
+  mp->cnt--;
+}
+
+#include "chadm.h"
+
+#endif /* CH_H */
@@ -0,0 +1,196 @@
+/*
+    This file is not part of the original ChibiOs 191.
+    Copyright (C) 2021 Antonio Emmanuele.
+*/
+/**
+ * @file    test/adm/test_adm.c
+ * @brief   Host test of the admission control analysis.
+ * @details The module is built with the stub kernel header of this directory,
+ *          the static functions are reached including the source:
+ *
+ *          gcc -Wall -Wextra -Itest/adm -IKernel/rt/include -o test_adm test/adm/test_adm.c
+ *          ./test_adm
+ *
+ *          The exit code is the number of the failed checks. The task sets are
+ *          in ticks, the priorities are explicit because there is no thread.
+ */
+
+#include <stdio.h>
+
+#include "../../Kernel/rt/src/chadm.c"
+
+#if SS_ADMISSION_RTA != TRUE
+#error "the admission cases expect the response time analysis"
+#endif
+
+static int failures;
+
+#define CHECK(c) do {                                                       \
+  if (!(c)) {                                                               \
+    printf("%s:%d: %s\n", __FILE__, __LINE__, #c);                          \
+    failures++;                                                             \
+  }                                                                         \
+} while (0)
+
+/*
+ * @brief   Inits a task without thread and links it in the set bypassing the admission
+ */
+static void task(adm_task_t *atp, tprio_t prio, sysinterval_t c, sysinterval_t t, sysinterval_t d) {
+
+  chAdmTaskObjectInit(atp, NULL, c, t, d);
+  atp->prio = prio;
+  __admLink(atp);
+  atp->admitted = true;
+}
+
+/*
+ * @brief   Empties the set
+ */
+static void reset(void) {
+
+  while (adm_list != NULL) {
+    adm_list->admitted = false;
+    __admUnlink(adm_list);
+  }
+}
+
+/*
+ * @brief   U=0.55, below the bound of three tasks, accepted by both tests
+ */
+static void test_light(void) {
+  adm_task_t a, b, c;
+
+  task(&a, 3, 1, 4, 0);
+  task(&b, 2, 1, 5, 0);
+  task(&c, 1, 1, 10, 0);
+  CHECK(__admUtilization());
+  CHECK(__admRta());
+  reset();
+}
+
+/*
+ * @brief   Burns-Wellings set, U=0.929 over the bound 0.780, R3=20=D3, accepted by the RTA only
+ */
+static void test_rta_only(void) {
+  adm_task_t a, b, c;
+
+  task(&a, 3, 3, 7, 0);
+  task(&b, 2, 3, 12, 0);
+  task(&c, 1, 5, 20, 0);
+  CHECK(!__admUtilization());
+  CHECK(__admTaskRta(&a));
+  CHECK(__admTaskRta(&b));
+  CHECK(__admTaskRta(&c));
+  CHECK(__admRta());
+  /* One more tick on the lowest task misses the deadline.*/
+  c.wcet = 6;
+  CHECK(!__admTaskRta(&c));
+  reset();
+}
+
+/*
+ * @brief   Harmonic set with U=1, schedulable, over the bound of two tasks 0.828
+ */
+static void test_harmonic(void) {
+  adm_task_t a, b;
+
+  task(&a, 2, 1, 2, 0);
+  task(&b, 1, 2, 4, 0);
+  CHECK(!__admUtilization());
+  CHECK(__admRta());
+  reset();
+}
+
+/*
+ * @brief   U=1.1, rejected by both tests
+ */
+static void test_overload(void) {
+  adm_task_t a, b;
+
+  task(&a, 2, 2, 4, 0);
+  task(&b, 1, 3, 5, 0);
+  CHECK(!__admUtilization());
+  CHECK(__admTaskRta(&a));
+  CHECK(!__admTaskRta(&b));
+  CHECK(!__admRta());
+  reset();
+}
+
+/*
+ * @brief   Equal priorities interfere with each other
+ */
+static void test_equal_prio(void) {
+  adm_task_t a, b;
+
+  task(&a, 1, 2, 4, 3);
+  task(&b, 1, 2, 4, 3);
+  /* R=4 for both, over the deadline 3.*/
+  CHECK(!__admRta());
+  a.deadline = 4;
+  b.deadline = 4;
+  CHECK(__admRta());
+  reset();
+}
+
+/*
+ * @brief   Deferrable server C=2 T=5 above a task C=5 T=10, the jitter T-C of the server raises
+ *          the response time of the task from 9 to 11
+ */
+static void test_deferrable_jitter(void) {
+  adm_task_t srv, t;
+
+  chAdmTaskObjectInit(&srv, NULL, 2, 5, 0);
+  srv.prio = 2;
+  chAdmTaskObjectInit(&t, NULL, 5, 10, 0);
+  t.prio = 1;
+  CHECK(chAdmTaskAdmit(&srv));
+  CHECK(chAdmTaskAdmit(&t));
+  CHECK(chAdmIsSchedulable());
+  /* The change is rejected and the old parameters are kept.*/
+  CHECK(!chAdmTaskChange(&srv, 2, 5, 0, 3));
+  CHECK(srv.jitter == 0);
+  CHECK(chAdmIsSchedulable());
+  /* The same jitter against a looser deadline, R=11<=12.*/
+  CHECK(chAdmTaskChange(&t, 5, 12, 0, 0));
+  CHECK(chAdmTaskChange(&srv, 2, 5, 0, 3));
+  CHECK(__admTaskRta(&srv));
+  CHECK(__admTaskRta(&t));
+  /* The jitter of a task is charged to its own response time too, R+J=2+4>5.*/
+  CHECK(!chAdmTaskChange(&srv, 2, 5, 0, 4));
+  chAdmTaskRemove(&t);
+  chAdmTaskRemove(&srv);
+  CHECK(adm_list == NULL);
+}
+
+/*
+ * @brief   A candidate is tested without being admitted
+ */
+static void test_candidate(void) {
+  adm_task_t a, b;
+
+  chAdmTaskObjectInit(&a, NULL, 2, 4, 0);
+  a.prio = 2;
+  chAdmTaskObjectInit(&b, NULL, 3, 5, 0);
+  b.prio = 1;
+  CHECK(chAdmTaskAdmit(&a));
+  CHECK(!chAdmResponseTimeTest(&b));
+  CHECK(!chAdmUtilizationTest(&b));
+  CHECK(!b.admitted);
+  CHECK(!chAdmTaskAdmit(&b));
+  CHECK(adm_list == &a);
+  chAdmTaskRemove(&a);
+}
+
+int main(void) {
+
+  test_light();
+  test_rta_only();
+  test_harmonic();
+  test_overload();
+  test_equal_prio();
+  test_deferrable_jitter();
+  test_candidate();
+  CHECK(adm_mtx.cnt == 0);
+  printf("%s, %d failures\n", failures == 0 ? "passed" : "FAILED", failures);
+  return failures;
+}
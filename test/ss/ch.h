@@ -0,0 +1,178 @@
+/*
+    This file is not part of the original ChibiOs 191.
+    Copyright (C) 2021 Antonio Emmanuele.
+*/
+/**
+ * @file    test/ss/ch.h
+ * @brief   Host stub of the kernel header for the sporadic server test.
+ * @note    It replaces the kernel header when chss.c is built on the host. The
+ *          ready list and the priority ordered insertion are the ones of the
+ *          kernel, the time and the virtual timers are driven by the test.
+ *          The budget is accounted in system ticks.
+ */
+#ifndef CH_H
+#define CH_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <assert.h>
+
+#define FALSE                       0
+#define TRUE                        1
+
+#define CH_CFG_USE_SS               TRUE
+#define CH_CFG_USE_SS_ADMISSION     FALSE
+#define CH_CFG_USE_MUTEXES          FALSE
+#define CH_CFG_USE_SEMAPHORES       FALSE
+#define CH_CFG_USE_EVENTS           FALSE
+#define CH_CFG_USE_MEMPOOLS         FALSE
+#define CH_CFG_USE_TM               FALSE
+#define CH_CFG_USE_DYNAMIC          FALSE
+#define CH_CFG_ST_FREQUENCY         1000
+#define CH_DBG_ENABLE_ASSERTS       TRUE
+#define CH_DBG_ENABLE_STACK_CHECK   FALSE
+#define PORT_SUPPORTS_RT            FALSE
+#define SPORADIC_POOL_SIZE          0
+
+#define NOPRIO                      (tprio_t)0
+#define NORMALPRIO                  (tprio_t)128
+#define HIGHPRIO                    (tprio_t)255
+
+#define CH_STATE_READY              (tstate_t)0
+#define CH_STATE_CURRENT            (tstate_t)1
+#define CH_STATE_WTSTART            (tstate_t)2
+#define CH_STATE_SUSPENDED          (tstate_t)3
+#define CH_STATE_SLEEPING           (tstate_t)8
+
+#define MSG_OK                      (msg_t)0
+#define MSG_TIMEOUT                 (msg_t)-1
+#define MSG_RESET                   (msg_t)-2
+
+#define TIME_MAX_SYSTIME            ((systime_t)-1)
+
+typedef uint32_t systime_t;
+typedef uint32_t sysinterval_t;
+typedef uint32_t rtcnt_t;
+typedef uint32_t ucnt_t;
+typedef uint32_t tprio_t;
+typedef uint8_t tstate_t;
+typedef int32_t msg_t;
+typedef uint64_t stkalign_t;
+
+typedef struct ch_thread thread_t;
+typedef thread_t *thread_reference_t;
+typedef struct ch_sporadic_server sporadic_server_t;
+typedef struct ApReq AperiodicRequest;
+
+typedef struct ch_threads_queue {
+  thread_t *next;
+  thread_t *prev;
+} threads_queue_t;
+
+struct ch_thread {
+  threads_queue_t queue;
+  tprio_t prio;
+  tstate_t state;
+  const char *name;
+  sporadic_server_t *ss;
+};
+
+typedef struct {
+  threads_queue_t queue;
+  tprio_t prio;
+  thread_t *current;
+} ready_list_t;
+
+typedef struct {
+  ready_list_t rlist;
+} ch_system_t;
+
+typedef void (*vtfunc_t)(void *p);
+
+typedef struct {
+  vtfunc_t func;
+  void *par;
+  systime_t deadline;
+  bool armed;
+} virtual_timer_t;
+
+extern ch_system_t ch;
+extern systime_t sim_now;
+
+#define currp                       ch.rlist.current
+
+#define THD_WORKING_AREA_SIZE(n)    (sizeof(thread_t) + (n) + 64U)
+#define THD_WORKING_AREA(s, n)      stkalign_t s[THD_WORKING_AREA_SIZE(n) / sizeof(stkalign_t)]
+#define THD_FUNCTION(tname, arg)    void tname(void *arg)
+#define PORT_STACK_ALIGN            sizeof(stkalign_t)
+#define PORT_WORKING_AREA_ALIGN     sizeof(stkalign_t)
+#define MEM_ALIGN_NEXT(p, a)        (((size_t)(p) + (size_t)(a) - 1U) & ~((size_t)(a) - 1U))
+#define MEM_IS_ALIGNED(p, a)        (((size_t)(p) & ((size_t)(a) - 1U)) == 0U)
+#define PORT_SETUP_CONTEXT(tp, wbase, wtop, pf, arg) (void)(pf)
+
+#define chDbgCheck(c)               assert(c)
+#define chDbgAssert(c, r)           assert(c)
+#define chDbgCheckClassI()
+#define chDbgCheckClassS()
+
+#define chSysLock()
+#define chSysUnlock()
+#define chSysLockFromISR()
+#define chSysUnlockFromISR()
+
+#define chTimeDiffX(start, end)     ((sysinterval_t)((systime_t)((end) - (start))))
+#define chTimeAddX(systime, delta)  ((systime_t)((systime) + (delta)))
+#define chVTGetSystemTimeX()        (sim_now)
+
+static inline void chVTObjectInit(virtual_timer_t *vtp) {
+  vtp->armed = false;
+}
+
+static inline bool chVTIsArmedI(const virtual_timer_t *vtp) {
+  return vtp->armed;
+}
+
+static inline void chVTDoSetI(virtual_timer_t *vtp, sysinterval_t delay,
+                              vtfunc_t vtfunc, void *par) {
+  assert(!vtp->armed);
+  vtp->func = vtfunc;
+  vtp->par = par;
+  vtp->deadline = sim_now + delay;
+  vtp->armed = true;
+}
+
+static inline void chVTDoResetI(virtual_timer_t *vtp) {
+  assert(vtp->armed);
+  vtp->armed = false;
+}
+
+static inline void queue_prio_insert(thread_t *tp, threads_queue_t *tqp) {
+  thread_t *cp = (thread_t *)tqp;
+
+  do {
+    cp = cp->queue.next;
+  } while ((cp != (thread_t *)tqp) && (cp->prio >= tp->prio));
+  tp->queue.next = cp;
+  tp->queue.prev = cp->queue.prev;
+  tp->queue.prev->queue.next = tp;
+  cp->queue.prev = tp;
+}
+
+static inline thread_t *queue_dequeue(thread_t *tp) {
+  tp->queue.prev->queue.next = tp->queue.next;
+  tp->queue.next->queue.prev = tp->queue.prev;
+  return tp;
+}
+
+thread_t *_thread_init(thread_t *tp, const char *name, tprio_t prio);
+thread_t *chSchReadyI(thread_t *tp);
+void chSchGoSleepS(tstate_t newstate);
+void chSchRescheduleS(void);
+msg_t chThdSuspendS(thread_reference_t *trp);
+msg_t chThdSuspendTimeoutS(thread_reference_t *trp, sysinterval_t timeout);
+void chThdResumeI(thread_reference_t *trp, msg_t msg);
+
+#include "chss.h"
+
+#endif /* CH_H */
@@ -0,0 +1,255 @@
+/*
+    This file is not part of the original ChibiOs 191.
+    Copyright (C) 2021 Antonio Emmanuele.
+*/
+/**
+ * @file    test/ss/test_ss.c
+ * @brief   Host test of the sporadic server scheduling.
+ * @details The module is built with the stub kernel header of this directory,
+ *          the test plays the scheduler: it moves the time, fires the virtual
+ *          timers and calls the context switch hook as the kernel does.
+ *
+ *          gcc -Wall -Wextra -Itest/ss -IKernel/rt/include -o test_ss test/ss/test_ss.c
+ *          ./test_ss
+ *
+ *          The exit code is the number of the failed checks.
+ */
+
+#include <stdio.h>
+
+#include "ch.h"
+#include "../../Kernel/rt/src/chss.c"
+
+ch_system_t ch;
+systime_t sim_now;
+
+static int failures;
+
+#define CHECK(c) do {                                                       \
+  if (!(c)) {                                                               \
+    printf("%s:%d: %s\n", __FILE__, __LINE__, #c);                          \
+    failures++;                                                             \
+  }                                                                         \
+} while (0)
+
+/*===========================================================================*/
+/* Scheduler model.                                                          */
+/*===========================================================================*/
+
+#define firstprio()                 (ch.rlist.queue.next->prio)
+
+thread_t *_thread_init(thread_t *tp, const char *name, tprio_t prio) {
+
+  tp->prio = prio;
+  tp->state = CH_STATE_WTSTART;
+  tp->name = name;
+  tp->ss = NULL;
+  return tp;
+}
+
+thread_t *chSchReadyI(thread_t *tp) {
+
+  tp->state = CH_STATE_READY;
+  queue_prio_insert(tp, &ch.rlist.queue);
+  return tp;
+}
+
+/*
+ * @brief   As chSchReadyAheadI(), the preempted thread goes before the threads of its priority
+ */
+static void sim_ready_ahead(thread_t *tp) {
+  thread_t *cp = (thread_t *)&ch.rlist.queue;
+
+  tp->state = CH_STATE_READY;
+  do {
+    cp = cp->queue.next;
+  } while (cp->prio > tp->prio);
+  tp->queue.next = cp;
+  tp->queue.prev = cp->queue.prev;
+  tp->queue.prev->queue.next = tp;
+  cp->queue.prev = tp;
+}
+
+/*
+ * @brief   Switches to the first ready thread, as chSchDoReschedule() the preempted thread goes back in the ready
+ *          list after the choice and the hook runs after both, as in chSysSwitch()
+ */
+static void sim_switch(thread_t *otp, bool preempted) {
+  thread_t *ntp = queue_dequeue(ch.rlist.queue.next);
+
+  ntp->state = CH_STATE_CURRENT;
+  currp = ntp;
+  if (preempted)
+    sim_ready_ahead(otp);
+  __sporadicserver_updatetime(ntp, otp);
+}
+
+void chSchRescheduleS(void) {
+
+  if (firstprio() > currp->prio)
+    sim_switch(currp, true);
+}
+
+void chSchGoSleepS(tstate_t newstate) {
+
+  currp->state = newstate;
+  sim_switch(currp, false);
+}
+
+/*
+ * @brief   Preemption check at the ISR exit, as chSchIsPreemptionRequired() and chSchDoReschedule()
+ */
+static void sim_isr_exit(void) {
+  thread_t *otp = currp;
+
+  if ((otp->ss != NULL) && otp->ss->ending) {
+    otp->ss->ending = false;
+  }
+  else if (firstprio() <= otp->prio) {
+    return;
+  }
+  sim_switch(otp, true);
+}
+
+/*
+ * @brief   Moves the time and fires a timer expiring at that time, as an ISR
+ */
+static void sim_fire(virtual_timer_t *vtp, systime_t now) {
+
+  sim_now = now;
+  if (vtp->armed && (vtp->deadline == now)) {
+    vtp->armed = false;
+    vtp->func(vtp->par);
+  }
+  sim_isr_exit();
+}
+
+msg_t chThdSuspendS(thread_reference_t *trp) {
+  (void)trp;
+  assert(false);
+  return MSG_OK;
+}
+
+msg_t chThdSuspendTimeoutS(thread_reference_t *trp, sysinterval_t timeout) {
+  (void)trp;
+  (void)timeout;
+  assert(false);
+  return MSG_OK;
+}
+
+void chThdResumeI(thread_reference_t *trp, msg_t msg) {
+  (void)trp;
+  (void)msg;
+}
+
+/*
+ * @brief   No ready thread has a priority higher than the running one
+ */
+static bool sim_order(void) {
+
+  return firstprio() <= currp->prio;
+}
+
+static bool sim_is_ready(const thread_t *tp) {
+  const thread_t *cp;
+
+  for (cp = ch.rlist.queue.next; cp != (thread_t *)&ch.rlist.queue; cp = cp->queue.next) {
+    if (cp == tp)
+      return true;
+  }
+  return false;
+}
+
+/*===========================================================================*/
+/* Test cases.                                                               */
+/*===========================================================================*/
+
+static THD_WORKING_AREA(wa_server, 256);
+static thread_t idle_thd, low_thd, mid_thd;
+static sporadic_server_t ss;
+
+static void request(void *arg) {
+  (void)arg;
+}
+
+static void setup(void) {
+
+  ch.rlist.queue.next = (thread_t *)&ch.rlist.queue;
+  ch.rlist.queue.prev = (thread_t *)&ch.rlist.queue;
+  ch.rlist.prio = NOPRIO;
+  sim_now = 0;
+  _ss_init();
+  (void)_thread_init(&idle_thd, "idle", 1);
+  (void)_thread_init(&low_thd, "low", 3);
+  (void)_thread_init(&mid_thd, "mid", 7);
+  (void)chSchReadyI(&idle_thd);
+  low_thd.state = CH_STATE_CURRENT;
+  currp = &low_thd;
+}
+
+/*
+ * @brief   An exhausted server with a background priority runs again only when no higher priority thread is ready
+ */
+static void test_background(void) {
+  static AperiodicRequest ap;
+  thread_t *wtp;
+
+  setup();
+  wtp = chSporadicServerObjectInit(&ss, wa_server, sizeof wa_server, 100, 10, 10, &ss_policy_sporadic);
+  chSporadicServerSetLowPriority(&ss, 5);
+  chSporadicServerAperiodicObjectInit(&ap, request, NULL);
+  (void)chSporadicServerAperiodicQueueInsertS(&ss, &ap);
+  chSchRescheduleS();
+  CHECK(currp == wtp);
+  CHECK(ss.reservation_vt.armed && (ss.reservation_vt.deadline == 10));
+
+  /* Exhausted with only lower threads ready, the worker keeps the cpu at the background priority.*/
+  sim_fire(&ss.reservation_vt, 10);
+  CHECK(ss.background);
+  CHECK(wtp->prio == 5);
+  CHECK(currp == wtp);
+  CHECK(sim_order());
+
+  /* A thread above the background priority preempts the worker.*/
+  sim_now = 12;
+  (void)chSchReadyI(&mid_thd);
+  sim_isr_exit();
+  CHECK(currp == &mid_thd);
+  CHECK(sim_order());
+
+  /* The worker runs again when no higher priority thread is ready, before the lower ones.*/
+  sim_now = 15;
+  chSchGoSleepS(CH_STATE_SUSPENDED);
+  CHECK(currp == wtp);
+  CHECK(sim_order());
+
+  /* A lower background priority is applied at once.*/
+  sim_now = 16;
+  chSporadicServerSetLowPriority(&ss, 2);
+  CHECK(wtp->prio == 2);
+  CHECK(currp == &low_thd);
+  CHECK(sim_order());
+
+  /* Without background priority the exhausted server is suspended.*/
+  sim_now = 17;
+  chSporadicServerSetLowPriority(&ss, NOPRIO);
+  CHECK(!ss.background);
+  CHECK(wtp->prio == 10);
+  CHECK(ss.worker.parked);
+  CHECK(!sim_is_ready(wtp));
+  CHECK(currp == &low_thd);
+
+  /* The replinishment puts it back in service.*/
+  CHECK(ss.rep_vt.armed && (ss.rep_vt.deadline == 100));
+  sim_fire(&ss.rep_vt, 100);
+  CHECK(ss.capacity == 10);
+  CHECK(currp == wtp);
+  CHECK(sim_order());
+}
+
+int main(void) {
+
+  test_background();
+  printf("%s, %d failures\n", failures == 0 ? "passed" : "FAILED", failures);
+  return failures;
+}